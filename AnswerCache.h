@@ -0,0 +1,286 @@
+#pragma once
+
+#include <span>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct CachedAnswer {
+    float Answer = 0.0f;
+    // 1 for the white bar and exact matches, the peak score for correlation.
+    float Confidence = 0.0f;
+};
+
+// Answers keyed by a hash of the background bytes, in a file every process
+// maps shared, so a captcha any of them solved costs the others a hash. The
+// table is open addressing over fixed slots with no locks: each slot has a
+// sequence number that is odd while a writer owns it, readers retry nothing
+// and treat a slot that changed under them as a miss, and a writer that finds
+// a slot busy skips the insert. Entries older than MaxAge read as misses and
+// are the first to be overwritten. A process killed mid-write leaves that
+// slot busy until the file is recreated.
+class AnswerCache {
+private:
+    struct Slot {
+        std::atomic<uint32_t> Sequence;
+        // Seconds since the Unix epoch.
+        std::atomic<uint32_t> Stamp;
+        std::atomic<uint64_t> Key;
+        std::atomic<uint32_t> Answer;
+        std::atomic<uint32_t> Confidence;
+        uint64_t Reserved;
+    };
+
+    struct Header {
+        std::atomic<uint64_t> Magic;
+        uint64_t Reserved[7];
+    };
+
+    static_assert(sizeof(Slot) == 32 && std::atomic<uint64_t>::is_always_lock_free, "Slots must be lock free to share between processes");
+
+    // "RTANSWR1", little-endian.
+    static constexpr uint64_t FileMagic = 0x315257534E415452ull;
+    // Slots searched from a key's home slot before giving up.
+    static constexpr size_t MaxProbe = 16;
+
+    void* View = nullptr;
+    size_t Bytes = 0;
+    Header* Head = nullptr;
+    Slot* Slots = nullptr;
+    size_t Capacity = 0;
+    uint32_t MaxAge;
+#ifdef _WIN32
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Mapping = nullptr;
+#endif
+
+public:
+    // Opens or creates the table at Path. A new file gets Entries slots; an
+    // existing one keeps the size it was made with. MaxAge is this process's
+    // view; processes may disagree.
+    explicit AnswerCache(const std::string& Path, size_t Entries = 1 << 16, std::chrono::seconds MaxAge = std::chrono::minutes(10))
+        : MaxAge(static_cast<uint32_t>(MaxAge.count())) {
+        CreateTable(Path, sizeof(Header) + std::max<size_t>(Entries, MaxProbe) * sizeof(Slot));
+#ifdef _WIN32
+        File = CreateFileA(Path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (File == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open answer cache");
+        }
+
+        LARGE_INTEGER FileSize;
+        if (!GetFileSizeEx(File, &FileSize)) {
+            CloseHandle(File);
+            throw std::runtime_error("Failed to open answer cache");
+        }
+
+        Bytes = static_cast<size_t>(FileSize.QuadPart);
+        Mapping = Bytes ? CreateFileMappingA(File, NULL, PAGE_READWRITE, 0, 0, NULL) : nullptr;
+        if (Mapping) {
+            View = MapViewOfFile(Mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        }
+        if (!View) {
+            if (Mapping) CloseHandle(Mapping);
+            CloseHandle(File);
+            throw std::runtime_error("Failed to map answer cache");
+        }
+#else
+        int fd = open(Path.c_str(), O_RDWR);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open answer cache");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to open answer cache");
+        }
+
+        Bytes = static_cast<size_t>(st.st_size);
+        View = Bytes ? mmap(nullptr, Bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (View == MAP_FAILED) {
+            View = nullptr;
+            throw std::runtime_error("Failed to map answer cache");
+        }
+#endif
+
+        Head = static_cast<Header*>(View);
+        Slots = reinterpret_cast<Slot*>(Head + 1);
+        Capacity = Bytes < sizeof(Header) ? 0 : (Bytes - sizeof(Header)) / sizeof(Slot);
+
+        uint64_t Magic = 0;
+        if (Capacity < MaxProbe ||
+            (!Head->Magic.compare_exchange_strong(Magic, FileMagic, std::memory_order_acq_rel) && Magic != FileMagic)) {
+            Unmap();
+            throw std::runtime_error("Not an answer cache");
+        }
+    }
+
+    ~AnswerCache() {
+        Unmap();
+    }
+
+    AnswerCache(const AnswerCache&) = delete;
+    AnswerCache& operator=(const AnswerCache&) = delete;
+
+    bool Find(uint64_t Hash, CachedAnswer& Out) const {
+        uint64_t Key = SlotKey(Hash);
+        uint32_t Now = Seconds();
+        for (size_t Probe = 0; Probe < MaxProbe; ++Probe) {
+            Slot& At = Slots[(Key + Probe) % Capacity];
+            uint32_t Before = At.Sequence.load(std::memory_order_acquire);
+            uint64_t Found = At.Key.load(std::memory_order_relaxed);
+            // Slots are never emptied, so an empty one ends the chain.
+            if (!Found && !(Before & 1)) return false;
+            if (Found != Key || (Before & 1)) continue;
+
+            uint32_t Stamp = At.Stamp.load(std::memory_order_relaxed);
+            uint32_t Answer = At.Answer.load(std::memory_order_relaxed);
+            uint32_t Confidence = At.Confidence.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (At.Sequence.load(std::memory_order_relaxed) != Before || Expired(Stamp, Now)) return false;
+
+            std::memcpy(&Out.Answer, &Answer, sizeof(Answer));
+            std::memcpy(&Out.Confidence, &Confidence, sizeof(Confidence));
+            return true;
+        }
+        return false;
+    }
+
+    // Overwrites Hash's slot, else takes an empty or expired one, else the
+    // oldest in its probe window. Returns false when the slot was busy.
+    bool Insert(uint64_t Hash, const CachedAnswer& Value) {
+        uint64_t Key = SlotKey(Hash);
+        uint32_t Now = Seconds();
+        Slot* Target = nullptr;
+        uint32_t TargetStamp = UINT32_MAX;
+        for (size_t Probe = 0; Probe < MaxProbe; ++Probe) {
+            Slot& At = Slots[(Key + Probe) % Capacity];
+            uint64_t Found = At.Key.load(std::memory_order_relaxed);
+            if (Found == Key) {
+                Target = &At;
+                break;
+            }
+            uint32_t Stamp = At.Stamp.load(std::memory_order_relaxed);
+            if (!Found || Expired(Stamp, Now)) Stamp = 0;
+            if (Stamp < TargetStamp) {
+                Target = &At;
+                TargetStamp = Stamp;
+            }
+            if (!Found) break;
+        }
+
+        uint32_t Sequence = Target->Sequence.load(std::memory_order_relaxed);
+        if ((Sequence & 1) || !Target->Sequence.compare_exchange_strong(Sequence, Sequence + 1, std::memory_order_acquire)) return false;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint32_t Answer, Confidence;
+        std::memcpy(&Answer, &Value.Answer, sizeof(Answer));
+        std::memcpy(&Confidence, &Value.Confidence, sizeof(Confidence));
+        Target->Key.store(Key, std::memory_order_relaxed);
+        Target->Stamp.store(Now, std::memory_order_relaxed);
+        Target->Answer.store(Answer, std::memory_order_relaxed);
+        Target->Confidence.store(Confidence, std::memory_order_relaxed);
+        Target->Sequence.store(Sequence + 2, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const {
+        return Capacity;
+    }
+
+private:
+    // Makes Path a zeroed table of Bytes unless it already exists. The file is
+    // sized under a temporary name and linked into place, so Path never holds
+    // a file shorter than the table it will be: processes creating it at once
+    // all end up mapping the one that got there first, at its size.
+    static void CreateTable(const std::string& Path, size_t Bytes) {
+#ifdef _WIN32
+        if (GetFileAttributesA(Path.c_str()) != INVALID_FILE_ATTRIBUTES) return;
+
+        std::string Temp = Path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+        HANDLE File = CreateFileA(Temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (File == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to create answer cache");
+        }
+
+        LARGE_INTEGER Size;
+        Size.QuadPart = static_cast<LONGLONG>(Bytes);
+        bool Ok = SetFilePointerEx(File, Size, NULL, FILE_BEGIN) && SetEndOfFile(File);
+        CloseHandle(File);
+        // Without MOVEFILE_REPLACE_EXISTING the move fails if another process
+        // created the table first, which is as good as succeeding.
+        if (Ok && !MoveFileExA(Temp.c_str(), Path.c_str(), 0)) {
+            DWORD Error = GetLastError();
+            Ok = Error == ERROR_ALREADY_EXISTS || Error == ERROR_FILE_EXISTS;
+        }
+        DeleteFileA(Temp.c_str());
+#else
+        if (access(Path.c_str(), F_OK) == 0) return;
+
+        std::string Temp = Path + ".XXXXXX";
+        int fd = mkstemp(Temp.data());
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create answer cache");
+        }
+
+        bool Ok = fchmod(fd, 0644) == 0 && ftruncate(fd, static_cast<off_t>(Bytes)) == 0;
+        close(fd);
+        // link, unlike rename, fails if another process created the table first.
+        if (Ok && link(Temp.c_str(), Path.c_str()) != 0) Ok = errno == EEXIST;
+        unlink(Temp.c_str());
+#endif
+        if (!Ok) {
+            throw std::runtime_error("Failed to create answer cache");
+        }
+    }
+
+    // 0 marks an empty slot.
+    static uint64_t SlotKey(uint64_t Hash) {
+        return Hash ? Hash : 1;
+    }
+
+    static uint32_t Seconds() {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    bool Expired(uint32_t Stamp, uint32_t Now) const {
+        return Now - Stamp > MaxAge;
+    }
+
+    void Unmap() {
+#ifdef _WIN32
+        if (View) UnmapViewOfFile(View);
+        if (Mapping) CloseHandle(Mapping);
+        if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+        Mapping = nullptr;
+        File = INVALID_HANDLE_VALUE;
+#else
+        if (View) munmap(View, Bytes);
+#endif
+        View = nullptr;
+    }
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <thread>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include "CaptchaSolver.h"
+#include "SyntheticCaptcha.h"
+
+struct BenchmarkConfig {
+    // Empty runs DefaultCases().
+    std::vector<SyntheticOptions> Cases;
+    // Captchas generated per case; each is timed once per stage.
+    int Iterations = 20;
+    // Workers for the end-to-end run.
+    int Threads = static_cast<int>(std::thread::hardware_concurrency());
+};
+
+// Exact percentiles over a handful of samples, in milliseconds.
+struct LatencyStats {
+    int Samples = 0;
+    double Mean = 0, P50 = 0, P90 = 0, P99 = 0, Max = 0;
+
+    explicit LatencyStats(std::vector<double> Times = {}) {
+        Samples = static_cast<int>(Times.size());
+        if (Times.empty()) return;
+
+        std::sort(Times.begin(), Times.end());
+        auto At = [&](double Quantile) { return Times[static_cast<size_t>(Quantile * (Times.size() - 1))]; };
+        double Total = 0;
+        for (double t : Times) Total += t;
+        Mean = Total / Times.size();
+        P50 = At(0.5);
+        P90 = At(0.9);
+        P99 = At(0.99);
+        Max = Times.back();
+    }
+};
+
+struct BenchmarkCase {
+    SyntheticOptions Options;
+    LatencyStats Decode, GetAnswer, MakeSquare, Match;
+    // Captchas whose stage answer matched the generated one.
+    int Correct = 0;
+    int Total = 0;
+
+    std::string Name() const {
+        char Out[96];
+        snprintf(Out, sizeof(Out), "%dx%d %s%s noise=%d %s", Options.Width, Options.Height, Options.Alpha ? "RGBA" : "RGB",
+                 Options.Packed ? " packed" : "", Options.Noise, Options.WhiteBar ? "white-bar" : "piece");
+        return Out;
+    }
+};
+
+struct BenchmarkReport {
+    std::vector<BenchmarkCase> Cases;
+    // Whole SolveCaptcha pipeline over every generated captcha on a
+    // CaptchaSolver with in-memory downloads.
+    int Solves = 0;
+    int CorrectReplies = 0;
+    int Threads = 0;
+    double Seconds = 0;
+
+    double SolvesPerSecond() const {
+        return Seconds > 0 ? Solves / Seconds : 0.0;
+    }
+
+    double SolvesPerSecondPerCore() const {
+        return Threads > 0 ? SolvesPerSecond() / Threads : 0.0;
+    }
+
+    std::string Format() const {
+        std::string Out;
+        char Line[256];
+        auto Stage = [&](const char* Name, const LatencyStats& Stats) {
+            if (!Stats.Samples) return;
+            snprintf(Line, sizeof(Line), "  %-12s mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f ms\n", Name, Stats.Mean, Stats.P50, Stats.P90,
+                     Stats.P99, Stats.Max);
+            Out += Line;
+        };
+        for (const BenchmarkCase& Case : Cases) {
+            snprintf(Line, sizeof(Line), "%s: %d/%d correct\n", Case.Name().c_str(), Case.Correct, Case.Total);
+            Out += Line;
+            Stage("decode", Case.Decode);
+            Stage("get_answer", Case.GetAnswer);
+            Stage("make_square", Case.MakeSquare);
+            Stage("match", Case.Match);
+        }
+        snprintf(Line, sizeof(Line), "end-to-end: %d/%d correct, %.0f solves/s on %d threads, %.0f per core\n", CorrectReplies, Solves,
+                 SolvesPerSecond(), Threads, SolvesPerSecondPerCore());
+        Out += Line;
+        return Out;
+    }
+};
+
+// Two sizes, both pixel formats, raw and RTPACK, with no noise, noise within
+// the tolerance and noise past it, for both the white-bar and the piece path.
+inline std::vector<SyntheticOptions> DefaultCases() {
+    std::vector<SyntheticOptions> Cases;
+    for (int Size : { 512, 1024 }) {
+        for (bool Alpha : { false, true }) {
+            for (bool Packed : { false, true }) {
+                for (int Noise : { 0, 2, 3 }) {
+                    for (bool WhiteBar : { true, false }) {
+                        SyntheticOptions Options;
+                        Options.Width = Size;
+                        Options.Height = Size / 2;
+                        Options.RealWidth = Size - Size / 16;
+                        Options.RealHeight = Size / 2 - Size / 32;
+                        Options.Alpha = Alpha;
+                        Options.Packed = Packed;
+                        Options.Noise = Noise;
+                        Options.WhiteBar = WhiteBar;
+                        Cases.push_back(Options);
+                    }
+                }
+            }
+        }
+    }
+    return Cases;
+}
+
+inline std::string ExpectedReply(float Answer, int Id) {
+    return CaptchaReply(Answer, std::to_string(Id));
+}
+
+// Times each stage on generated captchas with known answers, then runs them
+// all through CaptchaSolver. Uses the current CaptchaOptions for the search
+// settings; the fetcher, scheme and logging are swapped out for the run.
+inline BenchmarkReport RunBenchmark(const BenchmarkConfig& Config) {
+    using Clock = std::chrono::steady_clock;
+    auto Elapsed = [](Clock::time_point Start) { return std::chrono::duration<double, std::milli>(Clock::now() - Start).count(); };
+
+    SolverOptions Saved = CaptchaOptions;
+    auto Files = std::make_shared<MemoryFetcher>();
+    CaptchaOptions.Http = Files;
+    CaptchaOptions.Scheme = "mem://";
+    CaptchaOptions.Verbose = false;
+    // Every generated piece is new, so a cache would only add churn.
+    CaptchaOptions.Pieces = nullptr;
+
+    BenchmarkReport Report;
+    std::vector<variant_t> Dialogs;
+    std::vector<std::string> Expected;
+    std::vector<SyntheticOptions> Cases = Config.Cases.empty() ? DefaultCases() : Config.Cases;
+    // Noise past the tolerance only matches by correlation. Exact matches
+    // still end the search first, so the other cases time the same.
+    bool Noisy = std::any_of(Cases.begin(), Cases.end(), [](const SyntheticOptions& Options) { return Options.Noise > 2; });
+    if (Noisy && CaptchaOptions.Engine == MatchEngine::Exact) CaptchaOptions.Engine = MatchEngine::ExactThenCorrelation;
+
+    for (size_t c = 0; c < Cases.size(); ++c) {
+        BenchmarkCase Case;
+        Case.Options = Cases[c];
+        std::vector<double> Decode, Answer, Square, Match;
+
+        for (int i = 0; i < Config.Iterations; ++i) {
+            SyntheticOptions Options = Case.Options;
+            Options.Seed = static_cast<uint32_t>(c * 100003 + i + 1);
+            SyntheticCaptcha Captcha = MakeSyntheticCaptcha(Options);
+
+            auto Start = Clock::now();
+            RTTEX Image(Captcha.Background);
+            Decode.push_back(Elapsed(Start));
+
+            Start = Clock::now();
+            float Result = GetAnswer(Image);
+            Answer.push_back(Elapsed(Start));
+
+            if (!Options.WhiteBar) {
+                RTTEX PuzzlePiece(Captcha.Piece);
+                Start = Clock::now();
+                BitMap Cut = MakeSquare(PuzzlePiece);
+                Square.push_back(Elapsed(Start));
+
+                PieceModel Model(PieceTemplate(Cut, PuzzlePiece.Info.useAlpha), CorrelationPatch(Cut, PieceTemplate::Border));
+                Start = Clock::now();
+                Result = AnswerByEquation(Image, Model);
+                Match.push_back(Elapsed(Start));
+            }
+            Case.Correct += Result == Captcha.Answer;
+            ++Case.Total;
+
+            int Id = static_cast<int>(Dialogs.size());
+            std::string Name = "c" + std::to_string(Id);
+            Files->Serve("mem://bench/" + Name + ".rttex", std::move(Captcha.Background));
+            Files->Serve("mem://bench/" + Name + "p.rttex", std::move(Captcha.Piece));
+            Dialogs.emplace_back("add_puzzle_captcha|" + Name + ".rttex|" + Name + "p.rttex|bench|" + std::to_string(Id));
+            Expected.push_back(ExpectedReply(Captcha.Answer, Id));
+        }
+
+        Case.Decode = LatencyStats(std::move(Decode));
+        Case.GetAnswer = LatencyStats(std::move(Answer));
+        Case.MakeSquare = LatencyStats(std::move(Square));
+        Case.Match = LatencyStats(std::move(Match));
+        Report.Cases.push_back(Case);
+    }
+
+    {
+        CaptchaSolver Solver(Config.Threads);
+        Report.Threads = Solver.Size();
+        auto Start = Clock::now();
+        std::vector<std::string> Replies = Solver.SolveBatch(Dialogs);
+        Report.Seconds = Elapsed(Start) / 1000.0;
+        Report.Solves = static_cast<int>(Replies.size());
+        for (size_t i = 0; i < Replies.size(); ++i) {
+            Report.CorrectReplies += Replies[i] == Expected[i];
+        }
+    }
+
+    CaptchaOptions = Saved;
+    return Report;
+}
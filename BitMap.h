@@ -1,8 +1,10 @@
 #pragma once
 
+#include <span>
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include "BitMapPool.h"
 
 #pragma pack(push, 1)
 
@@ -43,33 +45,67 @@ struct RGB_A {
 
 #pragma pack(pop)
 
+// Specialized per format in PixelFormat.h.
+template <class Fmt>
+struct PixelFormat;
+
 class BitMap {
 private:
-    std::vector<uint8_t> Bits;
+    PixelBuffer Bits;
 
 public:
     int Height;
     int Width;
 
-    BitMap(int h, int w) : Height(h), Width(w), Bits(h * w * sizeof(int)) { }
+    // For maps that are about to be overwritten in full.
+    struct UninitializedTag { };
+    static constexpr UninitializedTag Uninitialized{};
+
+    BitMap(int h, int w) : BitMap(h, w, Uninitialized) {
+        if (Bits.size()) std::memset(Bits.data(), 0, Bits.size());
+    }
+
+    BitMap(int h, int w, UninitializedTag) : Bits(BitMapPool::Get().Acquire(static_cast<size_t>(h) * w * sizeof(int))), Height(h), Width(w) { }
+
+    BitMap(const BitMap& Other) : BitMap(Other.Height, Other.Width, Uninitialized) {
+        if (Bits.size()) std::memcpy(Bits.data(), Other.Bits.data(), Bits.size());
+    }
+
+    BitMap& operator=(const BitMap& Other) {
+        if (this != &Other) {
+            *this = BitMap(Other);
+        }
+        return *this;
+    }
+
+    BitMap(BitMap&&) noexcept = default;
+    BitMap& operator=(BitMap&&) noexcept = default;
 
     uint8_t* GetBitData() {
         return Bits.data();
     }
 
+    // Row y as a contiguous span of Fmt's in-memory pixels, e.g. Row<RGBA8>(y).
+    template <class Fmt>
+    std::span<typename PixelFormat<Fmt>::Pixel> Row(int y) {
+        using Pixel = typename PixelFormat<Fmt>::Pixel;
+        static_assert(sizeof(Pixel) == sizeof(int), "BitMap holds 4-byte pixels");
+        return { reinterpret_cast<Pixel*>(GetBitData(0, y)), static_cast<size_t>(Width) };
+    }
+
     uint8_t* GetBitData(int x, int y) {
-        return &Bits[(x + y * Width) * sizeof(int)];
+        return Bits.data() + (x + y * Width) * sizeof(int);
     }
 
     RGB_A GetPixelRGBA(int x, int y) {
         RGB_A pixel;
-        std::memcpy(&pixel, &Bits[(x + y * Width) * sizeof(int)], sizeof(RGB_A));
+        std::memcpy(&pixel, Bits.data() + (x + y * Width) * sizeof(int), sizeof(RGB_A));
         return pixel;
     }
 
     ColorRGB GetPixelRGB(int x, int y) {
         ColorRGB pixel;
-        std::memcpy(&pixel, &Bits[(x + y * Width) * sizeof(int)], sizeof(ColorRGB));
+        std::memcpy(&pixel, Bits.data() + (x + y * Width) * sizeof(int), sizeof(ColorRGB));
         return pixel;
     }
 };
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+class BitMapPool;
+
+// Owns one pooled pixel buffer and gives it back to its pool when destroyed.
+class PixelBuffer {
+private:
+    BitMapPool* Pool = nullptr;
+    uint8_t* Data = nullptr;
+    size_t Size = 0;
+    size_t Capacity = 0;
+
+public:
+    PixelBuffer() = default;
+    PixelBuffer(BitMapPool* Pool, uint8_t* Data, size_t Size, size_t Capacity)
+        : Pool(Pool), Data(Data), Size(Size), Capacity(Capacity) { }
+
+    PixelBuffer(PixelBuffer&& Other) noexcept
+        : Pool(std::exchange(Other.Pool, nullptr)), Data(std::exchange(Other.Data, nullptr)),
+          Size(std::exchange(Other.Size, 0)), Capacity(std::exchange(Other.Capacity, 0)) { }
+
+    PixelBuffer& operator=(PixelBuffer&& Other) noexcept {
+        if (this != &Other) {
+            Reset();
+            Pool = std::exchange(Other.Pool, nullptr);
+            Data = std::exchange(Other.Data, nullptr);
+            Size = std::exchange(Other.Size, 0);
+            Capacity = std::exchange(Other.Capacity, 0);
+        }
+        return *this;
+    }
+
+    PixelBuffer(const PixelBuffer&) = delete;
+    PixelBuffer& operator=(const PixelBuffer&) = delete;
+
+    ~PixelBuffer() {
+        Reset();
+    }
+
+    uint8_t* data() const {
+        return Data;
+    }
+
+    size_t size() const {
+        return Size;
+    }
+
+    inline void Reset();
+};
+
+struct BitMapPoolStats {
+    uint64_t Acquires = 0;
+    uint64_t Reuses = 0;
+    size_t BytesInUse = 0;
+    size_t PeakBytesInUse = 0;
+    size_t BytesCached = 0;
+};
+
+// Recycles pixel buffers between solves so steady load stops hitting the
+// allocator and faulting in fresh pages. Buffers are 64-byte aligned and
+// rounded up to a power-of-two size class; freed ones wait on a per-class
+// list until MaxCachedBytes is reached, after which they go back to the OS.
+class BitMapPool {
+private:
+    static constexpr size_t Alignment = 64;
+    static constexpr int MinClassShift = 12;
+    static constexpr int ClassCount = 20;
+
+    std::mutex Lock;
+    std::vector<uint8_t*> Free[ClassCount];
+    size_t MaxCachedBytes;
+    BitMapPoolStats Counters;
+
+public:
+    explicit BitMapPool(size_t MaxCachedBytes = 64 << 20) : MaxCachedBytes(MaxCachedBytes) { }
+
+    ~BitMapPool() {
+        for (int Class = 0; Class < ClassCount; ++Class) {
+            for (uint8_t* Buffer : Free[Class]) {
+                ::operator delete(Buffer, std::align_val_t(Alignment));
+            }
+        }
+    }
+
+    BitMapPool(const BitMapPool&) = delete;
+    BitMapPool& operator=(const BitMapPool&) = delete;
+
+    // Process-wide pool that BitMap allocates from. Never destroyed, so
+    // BitMaps in other statics can still release into it at exit.
+    static BitMapPool& Get() {
+        static BitMapPool* Shared = new BitMapPool();
+        return *Shared;
+    }
+
+    // Contents are unspecified.
+    PixelBuffer Acquire(size_t Size) {
+        if (Size == 0) return PixelBuffer();
+
+        int Class = ClassOf(Size);
+        size_t Capacity = Class < ClassCount ? ClassSize(Class) : Size;
+        uint8_t* Buffer = nullptr;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            ++Counters.Acquires;
+            if (Class < ClassCount && !Free[Class].empty()) {
+                Buffer = Free[Class].back();
+                Free[Class].pop_back();
+                Counters.BytesCached -= Capacity;
+                ++Counters.Reuses;
+            }
+            Counters.BytesInUse += Capacity;
+            Counters.PeakBytesInUse = std::max(Counters.PeakBytesInUse, Counters.BytesInUse);
+        }
+
+        if (!Buffer) {
+            Buffer = static_cast<uint8_t*>(::operator new(Capacity, std::align_val_t(Alignment)));
+        }
+        return PixelBuffer(this, Buffer, Size, Capacity);
+    }
+
+    void Release(uint8_t* Buffer, size_t Capacity) {
+        int Class = ClassOf(Capacity);
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Counters.BytesInUse -= Capacity;
+            if (Class < ClassCount && Counters.BytesCached + Capacity <= MaxCachedBytes) {
+                Free[Class].push_back(Buffer);
+                Counters.BytesCached += Capacity;
+                return;
+            }
+        }
+        ::operator delete(Buffer, std::align_val_t(Alignment));
+    }
+
+    // Hands every cached buffer back to the OS.
+    void Trim() {
+        std::vector<uint8_t*> Released;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            for (int Class = 0; Class < ClassCount; ++Class) {
+                Released.insert(Released.end(), Free[Class].begin(), Free[Class].end());
+                Free[Class].clear();
+            }
+            Counters.BytesCached = 0;
+        }
+        for (uint8_t* Buffer : Released) {
+            ::operator delete(Buffer, std::align_val_t(Alignment));
+        }
+    }
+
+    BitMapPoolStats Stats() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Counters;
+    }
+
+private:
+    static size_t ClassSize(int Class) {
+        return size_t(1) << (MinClassShift + Class);
+    }
+
+    // ClassCount for sizes too large to pool.
+    static int ClassOf(size_t Size) {
+        int Class = 0;
+        while (Class < ClassCount && ClassSize(Class) < Size) {
+            ++Class;
+        }
+        return Class;
+    }
+};
+
+inline void PixelBuffer::Reset() {
+    if (Data) Pool->Release(Data, Capacity);
+    Pool = nullptr;
+    Data = nullptr;
+    Size = 0;
+    Capacity = 0;
+}
+
+struct MemoryUsage {
+    size_t Resident = 0;
+    size_t PeakResident = 0;
+};
+
+// Resident set size of this process, now and at its peak, in bytes.
+inline MemoryUsage GetMemoryUsage() {
+    MemoryUsage Usage;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS Counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters))) {
+        Usage.Resident = Counters.WorkingSetSize;
+        Usage.PeakResident = Counters.PeakWorkingSetSize;
+    }
+#else
+    if (FILE* Statm = fopen("/proc/self/statm", "r")) {
+        unsigned long long Pages, Resident;
+        if (fscanf(Statm, "%llu %llu", &Pages, &Resident) == 2) {
+            Usage.Resident = static_cast<size_t>(Resident) * sysconf(_SC_PAGESIZE);
+        }
+        fclose(Statm);
+    }
+    rusage Self;
+    if (getrusage(RUSAGE_SELF, &Self) == 0) {
+#ifdef __APPLE__
+        Usage.PeakResident = static_cast<size_t>(Self.ru_maxrss);
+#else
+        Usage.PeakResident = static_cast<size_t>(Self.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return Usage;
+}
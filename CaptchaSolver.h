@@ -0,0 +1,126 @@
+#pragma once
+
+#include <span>
+#include <mutex>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "SolveCaptcha.h"
+#include "ThreadPool.h"
+
+// Solves captchas for many sessions on one fixed-size work-stealing pool
+// instead of a thread per caller. Each solve runs as separate tasks (parse and
+// start fetching, decode and white-bar scan, piece match) chained on fetch
+// completion, so a download in progress holds no worker.
+class CaptchaSolver {
+private:
+    StealingPool Workers;
+    std::mutex Lock;
+    std::condition_variable Idle;
+    int InFlight = 0;
+
+public:
+    explicit CaptchaSolver(int Threads = static_cast<int>(std::thread::hardware_concurrency())) : Workers(Threads) { }
+
+    // Waits for every submitted solve, so no callback outlives the solver.
+    ~CaptchaSolver() {
+        std::unique_lock<std::mutex> Guard(Lock);
+        Idle.wait(Guard, [this] { return InFlight == 0; });
+    }
+
+    CaptchaSolver(const CaptchaSolver&) = delete;
+    CaptchaSolver& operator=(const CaptchaSolver&) = delete;
+
+    // Done gets the reply SolveCaptcha would return, on a pool thread.
+    void Submit(variant_t Dialog, std::function<void(std::string)> Done) {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            ++InFlight;
+        }
+
+        auto Job = std::make_shared<CaptchaJob>();
+        auto Finish = std::make_shared<std::function<void(std::string)>>(std::move(Done));
+        Workers.Post([this, Job, Finish, Dialog = std::move(Dialog)] {
+            if (!StartCaptcha(Dialog, *Job)) {
+                Complete(*Finish, "");
+                return;
+            }
+
+            Job->Background->OnComplete([this, Job, Finish](FetchRequest&) {
+                Workers.Post([this, Job, Finish] {
+                    if (!SolveBackground(*Job)) {
+                        Complete(*Finish, FinishCaptcha(*Job));
+                    } else if (!Job->Piece) {
+                        SolvePiece(*Job);
+                        Complete(*Finish, FinishCaptcha(*Job));
+                    } else {
+                        Job->Piece->OnComplete([this, Job, Finish](FetchRequest&) {
+                            Workers.Post([this, Job, Finish] {
+                                SolvePiece(*Job);
+                                Complete(*Finish, FinishCaptcha(*Job));
+                            });
+                        });
+                    }
+                });
+            });
+        });
+    }
+
+    // Solves textures already in memory, replying as if to a dialog with CaptchaID.
+    // An empty Piece answers from the white bar alone.
+    void SubmitTextures(std::vector<uint8_t> Background, std::vector<uint8_t> Piece, std::string CaptchaID,
+                        std::function<void(std::string)> Done) {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            ++InFlight;
+        }
+
+        auto Finish = std::make_shared<std::function<void(std::string)>>(std::move(Done));
+        Workers.Post([this, Finish, Background = std::move(Background), Piece = std::move(Piece), CaptchaID = std::move(CaptchaID)] {
+            std::string Reply;
+            try {
+                Reply = CaptchaReply(SolveTextures(Background, Piece, ""), CaptchaID);
+            } catch (const std::exception& e) {
+                CaptchaLog("Failed to decode texture: %s\n", e.what());
+            }
+            Complete(*Finish, std::move(Reply));
+        });
+    }
+
+    std::future<std::string> Submit(variant_t Dialog) {
+        auto Reply = std::make_shared<std::promise<std::string>>();
+        std::future<std::string> Result = Reply->get_future();
+        Submit(std::move(Dialog), [Reply](std::string Answer) { Reply->set_value(std::move(Answer)); });
+        return Result;
+    }
+
+    // Replies in the order of Dialogs.
+    std::vector<std::string> SolveBatch(std::span<const variant_t> Dialogs) {
+        std::vector<std::future<std::string>> Pending;
+        Pending.reserve(Dialogs.size());
+        for (const variant_t& Dialog : Dialogs) {
+            Pending.push_back(Submit(Dialog));
+        }
+
+        std::vector<std::string> Replies;
+        Replies.reserve(Dialogs.size());
+        for (auto& Reply : Pending) {
+            Replies.push_back(Reply.get());
+        }
+        return Replies;
+    }
+
+    int Size() const {
+        return Workers.Size();
+    }
+
+private:
+    void Complete(std::function<void(std::string)>& Done, std::string Reply) {
+        Done(std::move(Reply));
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (--InFlight == 0) Idle.notify_all();
+    }
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <span>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/file.h>
+#endif
+
+// Captcha corpus pack: an 8 byte file header, then one record per solve,
+// appended and never rewritten. Each record is a CorpusRecordHeader followed
+// by the background bytes, the piece bytes and the four add_puzzle_captcha
+// fields, padded to 8 bytes so the next header is aligned. A sidecar
+// "<pack>.idx" holds the uint64 offset of every record so readers don't have
+// to walk the pack; records past the end of the index are found by walking.
+#pragma pack(push, 1)
+
+struct CorpusRecordHeader {
+    char Magic[4];
+    uint32_t HeaderSize;
+    uint64_t Timestamp;
+    float Answer;
+    uint32_t BackgroundSize;
+    uint32_t PieceSize;
+    uint16_t FieldSizes[4];
+};
+
+#pragma pack(pop)
+
+constexpr char CorpusFileMagic[8] = { 'R', 'T', 'C', 'O', 'R', 'P', 'U', '1' };
+constexpr char CorpusRecordMagic[4] = { 'C', 'R', 'E', 'C' };
+
+// One record, pointing into whoever holds the bytes.
+struct CorpusEntry {
+    std::span<const uint8_t> Background;
+    // Empty when the piece wasn't downloaded, e.g. the white bar answered.
+    std::span<const uint8_t> Piece;
+    // The add_puzzle_captcha values: background file, piece file, host, captcha ID.
+    std::string_view Fields[4];
+    float Answer = 0.0f;
+    // Milliseconds since the Unix epoch.
+    uint64_t Timestamp = 0;
+};
+
+inline size_t CorpusRecordSize(const CorpusRecordHeader& Header) {
+    size_t Size = sizeof(Header) + static_cast<size_t>(Header.BackgroundSize) + Header.PieceSize;
+    for (uint16_t Field : Header.FieldSizes) Size += Field;
+    return (Size + 7) & ~size_t(7);
+}
+
+// Appends solves to a pack and its index. Thread safe; every Append is flushed
+// so a crash loses at most the record being written. A pack has one recorder
+// at a time, across processes too: the constructor takes an exclusive lock on
+// the pack and throws if another recorder holds it. A failed write stops the
+// recorder, since the offsets it keeps would no longer match the file.
+class CorpusRecorder {
+private:
+    std::mutex Lock;
+    FILE* Pack = nullptr;
+    FILE* Index = nullptr;
+    uint64_t Offset = 0;
+    bool Broken = false;
+
+public:
+    explicit CorpusRecorder(const std::string& Path) {
+        Pack = fopen(Path.c_str(), "ab");
+        Index = fopen((Path + ".idx").c_str(), "ab");
+        if (!Pack || !Index) {
+            Close();
+            throw std::runtime_error("Failed to open corpus pack");
+        }
+        if (!LockPack()) {
+            Close();
+            throw std::runtime_error("Corpus pack is open in another recorder");
+        }
+
+        int64_t End = FileEnd(Pack);
+        if (End == 0) {
+            if (!Write(Pack, CorpusFileMagic, sizeof(CorpusFileMagic)) || fflush(Pack) != 0) End = -1;
+            else End = sizeof(CorpusFileMagic);
+        }
+        if (End < 0) {
+            Close();
+            throw std::runtime_error("Failed to open corpus pack");
+        }
+        Offset = static_cast<uint64_t>(End);
+    }
+
+    ~CorpusRecorder() {
+        Close();
+    }
+
+    CorpusRecorder(const CorpusRecorder&) = delete;
+    CorpusRecorder& operator=(const CorpusRecorder&) = delete;
+
+    void Append(const CorpusEntry& Entry) {
+        CorpusRecordHeader Header = {};
+        std::memcpy(Header.Magic, CorpusRecordMagic, sizeof(Header.Magic));
+        Header.HeaderSize = sizeof(Header);
+        Header.Timestamp = Entry.Timestamp ? Entry.Timestamp
+                                           : static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                 std::chrono::system_clock::now().time_since_epoch()).count());
+        Header.Answer = Entry.Answer;
+        Header.BackgroundSize = static_cast<uint32_t>(Entry.Background.size());
+        Header.PieceSize = static_cast<uint32_t>(Entry.Piece.size());
+        for (int i = 0; i < 4; ++i) {
+            if (Entry.Fields[i].size() > UINT16_MAX) throw std::runtime_error("Corpus field too long");
+            Header.FieldSizes[i] = static_cast<uint16_t>(Entry.Fields[i].size());
+        }
+
+        size_t Size = CorpusRecordSize(Header);
+        size_t Written = sizeof(Header) + Entry.Background.size() + Entry.Piece.size();
+        for (const std::string_view& Field : Entry.Fields) Written += Field.size();
+        static const uint8_t Padding[8] = {};
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (Broken) throw std::runtime_error("Corpus recorder stopped after a failed write");
+
+        // A record cut short is skipped by readers, and without its index
+        // entry nothing points at it.
+        bool Ok = Write(Pack, &Header, sizeof(Header)) && Write(Pack, Entry.Background.data(), Entry.Background.size()) &&
+                  Write(Pack, Entry.Piece.data(), Entry.Piece.size());
+        for (const std::string_view& Field : Entry.Fields) {
+            Ok = Ok && Write(Pack, Field.data(), Field.size());
+        }
+        Ok = Ok && Write(Pack, Padding, Size - Written) && fflush(Pack) == 0 && Write(Index, &Offset, sizeof(Offset)) && fflush(Index) == 0;
+        if (!Ok) {
+            Broken = true;
+            throw std::runtime_error("Failed to write corpus pack");
+        }
+        Offset += Size;
+    }
+
+private:
+    static bool Write(FILE* File, const void* Data, size_t Size) {
+        return Size == 0 || fwrite(Data, 1, Size, File) == Size;
+    }
+
+    // Size of the file in 64 bits, or -1.
+    static int64_t FileEnd(FILE* File) {
+#ifdef _WIN32
+        if (_fseeki64(File, 0, SEEK_END) != 0) return -1;
+        return _ftelli64(File);
+#else
+        if (fseeko(File, 0, SEEK_END) != 0) return -1;
+        return static_cast<int64_t>(ftello(File));
+#endif
+    }
+
+    // Released when the pack is closed, or by the system if the process dies.
+    bool LockPack() {
+#ifdef _WIN32
+        // A byte far past the end, so the lock never blocks readers.
+        OVERLAPPED At = {};
+        At.Offset = 0xFFFFFFFE;
+        At.OffsetHigh = 0x7FFFFFFF;
+        HANDLE File = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(Pack)));
+        return LockFileEx(File, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &At) != 0;
+#else
+        return flock(fileno(Pack), LOCK_EX | LOCK_NB) == 0;
+#endif
+    }
+
+    void Close() {
+        if (Pack) fclose(Pack);
+        if (Index) fclose(Index);
+        Pack = Index = nullptr;
+    }
+};
+
+// Read-only pack mapped into memory. Entries point straight into the mapping,
+// so replaying one copies nothing before the decoder reads it.
+class CorpusPack {
+private:
+    MappedFile File;
+    std::vector<uint64_t> Offsets;
+
+public:
+    explicit CorpusPack(const std::string& Path) : File(Path.c_str()) {
+        std::span<const uint8_t> Data = File.GetData();
+        if (Data.size() < sizeof(CorpusFileMagic) || std::memcmp(Data.data(), CorpusFileMagic, sizeof(CorpusFileMagic)) != 0) {
+            throw std::runtime_error("Not a corpus pack");
+        }
+
+        // Index entries may skip over a torn record that later appends
+        // followed; each must still point at a whole record.
+        uint64_t Next = sizeof(CorpusFileMagic);
+        if (FILE* Index = fopen((Path + ".idx").c_str(), "rb")) {
+            uint64_t Offset;
+            while (fread(&Offset, sizeof(Offset), 1, Index) == 1 && Offset >= Next && Fits(Offset)) {
+                Offsets.push_back(Offset);
+                Next = Offset + CorpusRecordSize(HeaderAt(Offset));
+            }
+            fclose(Index);
+        }
+        // A torn last record is left out.
+        while (Fits(Next)) {
+            Offsets.push_back(Next);
+            Next += CorpusRecordSize(HeaderAt(Next));
+        }
+    }
+
+    size_t Size() const {
+        return Offsets.size();
+    }
+
+    CorpusEntry operator[](size_t i) const {
+        const uint8_t* Record = File.GetData().data() + Offsets[i];
+        CorpusRecordHeader Header = HeaderAt(Offsets[i]);
+
+        CorpusEntry Entry;
+        const uint8_t* At = Record + Header.HeaderSize;
+        Entry.Background = { At, Header.BackgroundSize };
+        At += Header.BackgroundSize;
+        Entry.Piece = { At, Header.PieceSize };
+        At += Header.PieceSize;
+        for (int f = 0; f < 4; ++f) {
+            Entry.Fields[f] = { reinterpret_cast<const char*>(At), Header.FieldSizes[f] };
+            At += Header.FieldSizes[f];
+        }
+        Entry.Answer = Header.Answer;
+        Entry.Timestamp = Header.Timestamp;
+        return Entry;
+    }
+
+private:
+    CorpusRecordHeader HeaderAt(uint64_t Offset) const {
+        CorpusRecordHeader Header;
+        std::memcpy(&Header, File.GetData().data() + Offset, sizeof(Header));
+        return Header;
+    }
+
+    // A whole, well-formed record starts at Offset.
+    bool Fits(uint64_t Offset) const {
+        size_t Size = File.GetData().size();
+        // Offsets come from the index file, so nothing is added to them
+        // before they are known to be inside the pack.
+        if (Offset > Size || Size - Offset < sizeof(CorpusRecordHeader)) return false;
+
+        CorpusRecordHeader Header = HeaderAt(Offset);
+        if (std::memcmp(Header.Magic, CorpusRecordMagic, sizeof(Header.Magic)) != 0 || Header.HeaderSize != sizeof(Header)) return false;
+        return CorpusRecordSize(Header) <= Size - Offset;
+    }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "CorpusPack.h"
+#include "SolveCaptcha.h"
+
+struct ReplayReport {
+    size_t Entries = 0;
+    // Replays that gave the recorded answer, and those that didn't.
+    size_t Agreed = 0;
+    size_t Differed = 0;
+    // Entries whose textures no longer decode.
+    size_t Failed = 0;
+    int Threads = 0;
+    double Seconds = 0;
+
+    double SolvesPerSecond() const {
+        return Seconds > 0 ? Entries / Seconds : 0.0;
+    }
+};
+
+// Runs every entry of Pack through SolveTextures on Threads threads, straight
+// from the mapping, under the current CaptchaOptions. OnResult, when set, gets
+// each entry's index and new answer from the replaying thread.
+inline ReplayReport ReplayCorpus(const CorpusPack& Pack, int Threads = static_cast<int>(std::thread::hardware_concurrency()),
+                                 std::function<void(size_t, float)> OnResult = nullptr) {
+    ReplayReport Report;
+    Report.Entries = Pack.Size();
+    Report.Threads = std::max(1, Threads);
+
+    std::atomic<size_t> Next{ 0 }, Agreed{ 0 }, Differed{ 0 }, Failed{ 0 };
+    auto Replay = [&] {
+        for (size_t i = Next++; i < Pack.Size(); i = Next++) {
+            CorpusEntry Entry = Pack[i];
+            // Keyed like StartCaptcha's piece link. Entries recorded without
+            // their piece look it up by this URL with KeyPiecesByUrl.
+            std::string PieceUrl = CaptchaOptions.Scheme;
+            PieceUrl.append(Entry.Fields[2]).append("/").append(Entry.Fields[1]);
+            float Answer;
+            try {
+                Answer = SolveTextures(Entry.Background, Entry.Piece, PieceUrl);
+            } catch (const std::exception&) {
+                ++Failed;
+                continue;
+            }
+            ++(Answer == Entry.Answer ? Agreed : Differed);
+            if (OnResult) OnResult(i, Answer);
+        }
+    };
+
+    auto Start = std::chrono::steady_clock::now();
+    std::vector<std::thread> Workers;
+    for (int t = 1; t < Report.Threads; ++t) {
+        Workers.emplace_back(Replay);
+    }
+    Replay();
+    for (auto& Worker : Workers) {
+        Worker.join();
+    }
+    Report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    Report.Agreed = Agreed;
+    Report.Differed = Differed;
+    Report.Failed = Failed;
+    return Report;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <complex>
+#include <numbers>
+#include <algorithm>
+#include "BitMap.h"
+#include "PixelFormat.h"
+
+using Complex = std::complex<float>;
+
+// Plain product. operator* on std::complex goes through the C99 NaN/infinity
+// recovery path, which costs more than the butterfly itself.
+inline Complex Multiply(Complex a, Complex b) {
+    return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Iterative radix-2 FFT of one power-of-two size. Twiddles and the bit
+// reversal table are built once and shared by every row or column run.
+// The inverse is unscaled.
+class FFTPlan {
+private:
+    int Size;
+    std::vector<Complex> Twiddles;
+    std::vector<int> Reversed;
+
+public:
+    explicit FFTPlan(int Size) : Size(Size), Twiddles(Size / 2), Reversed(Size) {
+        for (int k = 0; k < Size / 2; ++k) {
+            double Angle = -2.0 * std::numbers::pi * k / Size;
+            Twiddles[k] = Complex(static_cast<float>(std::cos(Angle)), static_cast<float>(std::sin(Angle)));
+        }
+        int Bits = 0;
+        while ((1 << Bits) < Size) ++Bits;
+        for (int i = 0; i < Size; ++i) {
+            int r = 0;
+            for (int b = 0; b < Bits; ++b) {
+                r |= ((i >> b) & 1) << (Bits - 1 - b);
+            }
+            Reversed[i] = r;
+        }
+    }
+
+    void Run(Complex* Data, bool Inverse) const {
+        for (int i = 0; i < Size; ++i) {
+            if (i < Reversed[i]) std::swap(Data[i], Data[Reversed[i]]);
+        }
+        for (int Length = 2; Length <= Size; Length <<= 1) {
+            int Half = Length / 2;
+            int Step = Size / Length;
+            for (int Start = 0; Start < Size; Start += Length) {
+                for (int j = 0; j < Half; ++j) {
+                    Complex w = Inverse ? std::conj(Twiddles[j * Step]) : Twiddles[j * Step];
+                    Complex Odd = Multiply(Data[Start + j + Half], w);
+                    Data[Start + j + Half] = Data[Start + j] - Odd;
+                    Data[Start + j] += Odd;
+                }
+            }
+        }
+    }
+};
+
+// Rows in place, then columns through a scratch buffer to keep them contiguous.
+inline void FFT2D(std::vector<Complex>& Data, int Width, int Height, bool Inverse) {
+    FFTPlan Rows(Width), Columns(Height);
+    for (int y = 0; y < Height; ++y) {
+        Rows.Run(Data.data() + static_cast<size_t>(y) * Width, Inverse);
+    }
+    std::vector<Complex> Column(Height);
+    for (int x = 0; x < Width; ++x) {
+        for (int y = 0; y < Height; ++y) Column[y] = Data[static_cast<size_t>(y) * Width + x];
+        Columns.Run(Column.data(), Inverse);
+        for (int y = 0; y < Height; ++y) Data[static_cast<size_t>(y) * Width + x] = Column[y];
+    }
+}
+
+// Zero-mean luma block of a piece, ready to correlate.
+struct CorrelationPatch {
+    int Width = 0;
+    int Height = 0;
+    std::vector<float> Values;
+    // sqrt of the sum of squared values.
+    float Norm = 0.0f;
+
+    CorrelationPatch() = default;
+
+    // The Square's interior inside Border, the same block the exact matcher
+    // compares from its first pixel on.
+    CorrelationPatch(BitMap& Square, int Border) {
+        Width = Square.Width - Border * 2;
+        Height = Square.Height - Border * 2;
+        if (Width <= 0 || Height <= 0) {
+            Width = Height = 0;
+            return;
+        }
+
+        Values.resize(static_cast<size_t>(Width) * Height);
+        std::vector<uint8_t> Luma(Width);
+        double Sum = 0;
+        for (int y = 0; y < Height; ++y) {
+            LumaRow(Square.Row<RGBA8>(Border + y).data() + Border, Luma.data(), Width);
+            for (int x = 0; x < Width; ++x) {
+                Values[y * Width + x] = Luma[x];
+                Sum += Luma[x];
+            }
+        }
+
+        float Mean = static_cast<float>(Sum / Values.size());
+        double Energy = 0;
+        for (float& v : Values) {
+            v -= Mean;
+            Energy += static_cast<double>(v) * v;
+        }
+        Norm = static_cast<float>(std::sqrt(Energy));
+    }
+
+    // A flat patch correlates with nothing.
+    bool Valid() const {
+        return Norm > 0.0f;
+    }
+};
+
+struct CorrelationMatch {
+    int X = -1;
+    int Y = -1;
+    // Normalized cross-correlation at the peak, in [-1, 1].
+    float Score = 0.0f;
+};
+
+// Normalized cross-correlation of Patch against every origin of Image's luma
+// with X < XLimit and Y < YLimit whose block fits inside the image. The
+// numerator comes from one FFT round trip over the padded image, with the
+// image and patch packed as the real and imaginary parts of one transform;
+// the per-window mean and energy come from summed-area tables. The cost
+// depends on the image size only. The first origin in raster order wins ties.
+inline CorrelationMatch FindByCorrelation(LumaPlane& Image, int XLimit, int YLimit, const CorrelationPatch& Patch) {
+    CorrelationMatch Best;
+    int XEnd = std::min(XLimit, Image.Width - Patch.Width + 1);
+    int YEnd = std::min(YLimit, Image.Height - Patch.Height + 1);
+    if (!Patch.Valid() || XEnd <= 0 || YEnd <= 0) return Best;
+
+    int Width = 1, Height = 1;
+    while (Width < Image.Width) Width <<= 1;
+    while (Height < Image.Height) Height <<= 1;
+
+    std::vector<Complex> Packed(static_cast<size_t>(Width) * Height);
+    for (int y = 0; y < Image.Height; ++y) {
+        const uint8_t* Row = Image.Row(y).data();
+        for (int x = 0; x < Image.Width; ++x) {
+            Packed[static_cast<size_t>(y) * Width + x].real(Row[x]);
+        }
+    }
+    for (int y = 0; y < Patch.Height; ++y) {
+        for (int x = 0; x < Patch.Width; ++x) {
+            Packed[static_cast<size_t>(y) * Width + x].imag(Patch.Values[y * Patch.Width + x]);
+        }
+    }
+    FFT2D(Packed, Width, Height, false);
+
+    // Split the two real spectra, I = (Z[k] + conj Z[-k]) / 2 and
+    // P = (Z[k] - conj Z[-k]) / 2i, and form I * conj P. Pairs are done
+    // together since each needs the other's input.
+    std::vector<Complex> Product(Packed.size());
+    for (int ky = 0; ky < Height; ++ky) {
+        for (int kx = 0; kx < Width; ++kx) {
+            Complex z = Packed[static_cast<size_t>(ky) * Width + kx];
+            Complex m = std::conj(Packed[static_cast<size_t>((Height - ky) & (Height - 1)) * Width + ((Width - kx) & (Width - 1))]);
+            Complex I = (z + m) * 0.5f;
+            Complex P = Multiply(z - m, Complex(0.0f, -0.5f));
+            Product[static_cast<size_t>(ky) * Width + kx] = Multiply(I, std::conj(P));
+        }
+    }
+    FFT2D(Product, Width, Height, true);
+    float Scale = 1.0f / (static_cast<float>(Width) * Height);
+
+    // Summed-area tables of luma and luma squared, one row and column of zeros first.
+    int Stride = Image.Width + 1;
+    std::vector<double> Sum(static_cast<size_t>(Stride) * (Image.Height + 1)), Squares(Sum.size());
+    for (int y = 0; y < Image.Height; ++y) {
+        const uint8_t* Row = Image.Row(y).data();
+        double RowSum = 0, RowSquares = 0;
+        for (int x = 0; x < Image.Width; ++x) {
+            RowSum += Row[x];
+            RowSquares += Row[x] * Row[x];
+            size_t At = static_cast<size_t>(y + 1) * Stride + x + 1;
+            Sum[At] = Sum[At - Stride] + RowSum;
+            Squares[At] = Squares[At - Stride] + RowSquares;
+        }
+    }
+    auto Window = [&](const std::vector<double>& Table, int x, int y) {
+        size_t Top = static_cast<size_t>(y) * Stride + x;
+        size_t Bottom = static_cast<size_t>(y + Patch.Height) * Stride + x;
+        return Table[Bottom + Patch.Width] - Table[Bottom] - Table[Top + Patch.Width] + Table[Top];
+    };
+
+    // Luma is whole levels, so a window that isn't flat has at least about
+    // one level squared of energy; anything under half that is rounding in the
+    // tables, and dividing by it would blow the FFT's rounding up into scores
+    // far outside [-1, 1].
+    const double MinVariance = 0.5;
+    double Count = static_cast<double>(Patch.Width) * Patch.Height;
+    for (int y = 0; y < YEnd; ++y) {
+        for (int x = 0; x < XEnd; ++x) {
+            double s = Window(Sum, x, y);
+            double Variance = Window(Squares, x, y) - s * s / Count;
+            if (!(Variance >= MinVariance)) continue;
+
+            double Raw = Product[static_cast<size_t>(y) * Width + x].real() * Scale / (std::sqrt(Variance) * Patch.Norm);
+            if (!std::isfinite(Raw)) continue;
+            float Score = static_cast<float>(std::clamp(Raw, -1.0, 1.0));
+            if (Score > Best.Score || Best.X < 0) {
+                Best = { x, y, Score };
+            }
+        }
+    }
+    return Best;
+}
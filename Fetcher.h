@@ -0,0 +1,428 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <condition_variable>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <winhttp.h>
+
+#pragma comment(lib, "Winhttp.lib")
+#endif
+
+// One download in flight. Fetchers fill it in with Complete, optionally after
+// handing over the body a chunk at a time with Append; callers either block on
+// Wait or register an OnComplete callback, and may Cancel at any time.
+class FetchRequest {
+private:
+    using DataCallback = std::function<void(FetchRequest&, std::span<const uint8_t>)>;
+
+    std::mutex Lock;
+    // Held while Body grows and OnData callbacks run, so each callback sees
+    // every byte exactly once and in order.
+    std::mutex StreamLock;
+    std::condition_variable Done;
+    std::vector<std::function<void(FetchRequest&)>> Callbacks;
+    std::vector<DataCallback> DataCallbacks;
+    std::function<void()> Abort;
+    std::vector<uint8_t> Body;
+    std::atomic<bool> Cancelled{ false };
+    bool Finished = false;
+    bool Succeeded = false;
+
+public:
+    // Null when the download failed or was cancelled.
+    const std::vector<uint8_t>* Wait() {
+        std::unique_lock<std::mutex> Guard(Lock);
+        Done.wait(Guard, [this] { return Finished; });
+        return Succeeded ? &Body : nullptr;
+    }
+
+    const std::vector<uint8_t>* Result() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Finished && Succeeded ? &Body : nullptr;
+    }
+
+    // Runs Callback on the completing thread, or right away if already done.
+    void OnComplete(std::function<void(FetchRequest&)> Callback) {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (!Finished) {
+                Callbacks.push_back(std::move(Callback));
+                return;
+            }
+        }
+        Callback(*this);
+    }
+
+    // Runs Callback with every chunk of the body as it arrives, on the fetcher's
+    // thread. Bytes already received are passed right away. A failed download
+    // just stops calling it. Callback may Cancel but must not Wait.
+    void OnData(DataCallback Callback) {
+        std::lock_guard<std::mutex> Stream(StreamLock);
+        bool Ended;
+        bool Delivered;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Ended = Finished;
+            Delivered = !Finished || Succeeded;
+        }
+        if (Delivered && !Body.empty()) Callback(*this, Body);
+        if (!Ended) DataCallbacks.push_back(std::move(Callback));
+    }
+
+    void Cancel() {
+        std::function<void()> Hook;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Cancelled = true;
+            Hook = std::move(Abort);
+            Abort = nullptr;
+        }
+        if (Hook) Hook();
+    }
+
+    bool IsCancelled() const {
+        return Cancelled;
+    }
+
+    // For fetchers: Hook interrupts the transfer from another thread. Returns
+    // false if the request was already cancelled.
+    bool SetAbort(std::function<void()> Hook) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (Cancelled) return false;
+        Abort = std::move(Hook);
+        return true;
+    }
+
+    // For fetchers: takes back the hook. Returns false if Cancel already ran it.
+    bool ClearAbort() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        bool Pending = static_cast<bool>(Abort);
+        Abort = nullptr;
+        return Pending;
+    }
+
+    // For fetchers: the next bytes of the body, before Complete(bool).
+    void Append(std::span<const uint8_t> Chunk) {
+        std::lock_guard<std::mutex> Stream(StreamLock);
+        size_t Offset = Body.size();
+        Body.insert(Body.end(), Chunk.begin(), Chunk.end());
+        for (auto& Callback : DataCallbacks) {
+            Callback(*this, std::span<const uint8_t>(Body).subspan(Offset));
+        }
+    }
+
+    // For fetchers that download the whole body before handing it over.
+    void Complete(bool Success, std::vector<uint8_t> Data) {
+        std::unique_lock<std::mutex> Stream(StreamLock);
+        Body = std::move(Data);
+        if (Success && !Cancelled && !Body.empty()) {
+            for (auto& Callback : DataCallbacks) {
+                Callback(*this, Body);
+            }
+        }
+        Finish(Success, Stream);
+    }
+
+    // For fetchers that appended the body.
+    void Complete(bool Success) {
+        std::unique_lock<std::mutex> Stream(StreamLock);
+        Finish(Success, Stream);
+    }
+
+private:
+    void Finish(bool Success, std::unique_lock<std::mutex>& Stream) {
+        std::vector<std::function<void(FetchRequest&)>> Pending;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Succeeded = Success && !Cancelled;
+            Finished = true;
+            Pending.swap(Callbacks);
+        }
+        DataCallbacks.clear();
+        Stream.unlock();
+        Done.notify_all();
+        for (auto& Callback : Pending) {
+            Callback(*this);
+        }
+    }
+};
+
+class Fetcher {
+public:
+    virtual ~Fetcher() = default;
+
+    // Starts downloading Url into memory and returns immediately.
+    virtual std::shared_ptr<FetchRequest> Fetch(const std::string& Url) = 0;
+};
+
+// Serves files from memory and completes every request before Fetch returns.
+// Unknown URLs fail. Lets the whole pipeline run without any network.
+class MemoryFetcher : public Fetcher {
+private:
+    std::mutex Lock;
+    std::map<std::string, std::vector<uint8_t>> Files;
+
+public:
+    void Serve(const std::string& Url, std::vector<uint8_t> Body) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Files[Url] = std::move(Body);
+    }
+
+    std::shared_ptr<FetchRequest> Fetch(const std::string& Url) override {
+        auto Request = std::make_shared<FetchRequest>();
+        std::vector<uint8_t> Body;
+        bool Found;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            auto It = Files.find(Url);
+            Found = It != Files.end();
+            if (Found) Body = It->second;
+        }
+        Request->Complete(Found, std::move(Body));
+        return Request;
+    }
+};
+
+#ifdef _WIN32
+// WinHTTP in asynchronous mode over one session, which keeps finished
+// connections alive and hands them to the next request for the same host.
+// Every call returns at once and WinHTTP's own threads carry each transfer
+// forward through StatusCallback, so Fetch never blocks the caller.
+class WinHttpFetcher : public Fetcher {
+private:
+    struct InternetHandle {
+        HINTERNET Handle = nullptr;
+
+        explicit InternetHandle(HINTERNET Handle) : Handle(Handle) { }
+        ~InternetHandle() {
+            if (Handle) WinHttpCloseHandle(Handle);
+        }
+
+        InternetHandle(const InternetHandle&) = delete;
+        InternetHandle& operator=(const InternetHandle&) = delete;
+    };
+
+    // One request handle and where its transfer is. The handle is only used
+    // and closed under Lock, and never once Closed, so Cancel can't close it
+    // between another thread's check and its call: a closed handle's value may
+    // already belong to another request. Async calls don't block, so holding
+    // Lock across them never holds up Cancel. Self keeps the transfer alive
+    // until WinHTTP reports the handle closing, its last callback.
+    struct Transfer {
+        WinHttpFetcher& Owner;
+        std::shared_ptr<FetchRequest> Request;
+        std::shared_ptr<Transfer> Self;
+        HINTERNET Handle;
+        // Completions may arrive on the calling thread, inside the call.
+        std::recursive_mutex Lock;
+        bool Closed = false;
+        bool Ok = false;
+        size_t Received = 0;
+        std::vector<uint8_t> Chunk;
+
+        Transfer(WinHttpFetcher& Owner, std::shared_ptr<FetchRequest> Request, HINTERNET Handle)
+            : Owner(Owner), Request(std::move(Request)), Handle(Handle) { }
+
+        // Closes the handle once; HANDLE_CLOSING then completes the request.
+        void Close(bool Success) {
+            std::lock_guard<std::recursive_mutex> Guard(Lock);
+            if (Closed) return;
+            Closed = true;
+            Ok = Success;
+            WinHttpCloseHandle(Handle);
+        }
+
+        // Runs Call on the open handle; a call that fails ends the transfer.
+        template <class Fn>
+        void Next(Fn&& Call) {
+            std::lock_guard<std::recursive_mutex> Guard(Lock);
+            if (Closed) return;
+            if (!Call(Handle)) Close(false);
+        }
+    };
+
+    // Destroyed in reverse: every transfer has closed before any handle here.
+    InternetHandle Session;
+    std::mutex Lock;
+    std::condition_variable Idle;
+    std::map<std::wstring, std::unique_ptr<InternetHandle>> Connections;
+    std::set<Transfer*> Live;
+
+public:
+    WinHttpFetcher()
+        : Session(WinHttpOpen(L"Mozilla/5.0", WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS,
+                              WINHTTP_FLAG_ASYNC)) {
+        if (!Session.Handle) {
+            throw std::runtime_error("Failed to open WinHTTP session");
+        }
+    }
+
+    // Cancels whatever is still downloading and waits for it to close.
+    ~WinHttpFetcher() {
+        std::vector<std::shared_ptr<FetchRequest>> Pending;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            for (Transfer* Running : Live) {
+                Pending.push_back(Running->Request);
+            }
+        }
+        for (auto& Request : Pending) {
+            Request->Cancel();
+        }
+        std::unique_lock<std::mutex> Guard(Lock);
+        Idle.wait(Guard, [this] { return Live.empty(); });
+    }
+
+    WinHttpFetcher(const WinHttpFetcher&) = delete;
+    WinHttpFetcher& operator=(const WinHttpFetcher&) = delete;
+
+    std::shared_ptr<FetchRequest> Fetch(const std::string& Url) override {
+        auto Request = std::make_shared<FetchRequest>();
+
+        std::wstring WideUrl(Url.begin(), Url.end());
+        URL_COMPONENTS Parts = {};
+        Parts.dwStructSize = sizeof(Parts);
+        Parts.dwSchemeLength = static_cast<DWORD>(-1);
+        Parts.dwHostNameLength = static_cast<DWORD>(-1);
+        Parts.dwUrlPathLength = static_cast<DWORD>(-1);
+        Parts.dwExtraInfoLength = static_cast<DWORD>(-1);
+        if (!WinHttpCrackUrl(WideUrl.c_str(), 0, 0, &Parts)) {
+            Request->Complete(false, {});
+            return Request;
+        }
+
+        std::wstring Host(Parts.lpszHostName, Parts.dwHostNameLength);
+        std::wstring Path(Parts.lpszUrlPath, Parts.dwUrlPathLength + Parts.dwExtraInfoLength);
+        HINTERNET Connection = GetConnection(Host, Parts.nPort);
+        HINTERNET Handle = Connection ? WinHttpOpenRequest(Connection, L"GET", Path.c_str(), NULL, WINHTTP_NO_REFERER,
+                                                           WINHTTP_DEFAULT_ACCEPT_TYPES,
+                                                           Parts.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0)
+                                      : nullptr;
+        if (!Handle) {
+            Request->Complete(false, {});
+            return Request;
+        }
+
+        auto Job = std::make_shared<Transfer>(*this, Request, Handle);
+        DWORD_PTR Context = reinterpret_cast<DWORD_PTR>(Job.get());
+        if (WinHttpSetStatusCallback(Handle, StatusCallback, WINHTTP_CALLBACK_FLAG_ALL_COMPLETIONS | WINHTTP_CALLBACK_FLAG_HANDLES, 0) ==
+                WINHTTP_INVALID_STATUS_CALLBACK ||
+            !WinHttpSetOption(Handle, WINHTTP_OPTION_CONTEXT_VALUE, &Context, sizeof(Context))) {
+            WinHttpCloseHandle(Handle);
+            Request->Complete(false, {});
+            return Request;
+        }
+
+        // From here the handle closing, however it happens, completes Request.
+        Job->Self = Job;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Live.insert(Job.get());
+        }
+        // Cancel closes the handle, which fails the call in progress.
+        if (!Request->SetAbort([Job] { Job->Close(false); })) {
+            Job->Close(false);
+            return Request;
+        }
+        Job->Next([Context](HINTERNET Handle) {
+            return WinHttpSendRequest(Handle, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, Context);
+        });
+        return Request;
+    }
+
+private:
+    HINTERNET GetConnection(const std::wstring& Host, INTERNET_PORT Port) {
+        std::wstring Key = Host + L":" + std::to_wstring(Port);
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto& Connection = Connections[Key];
+        if (!Connection) {
+            HINTERNET Handle = WinHttpConnect(Session.Handle, Host.c_str(), Port, 0);
+            if (!Handle) return nullptr;
+            Connection = std::make_unique<InternetHandle>(Handle);
+        }
+        return Connection->Handle;
+    }
+
+    static void CALLBACK StatusCallback(HINTERNET, DWORD_PTR Context, DWORD Status, LPVOID Info, DWORD InfoLength) {
+        Transfer* Job = reinterpret_cast<Transfer*>(Context);
+        if (!Job) return;
+
+        switch (Status) {
+        case WINHTTP_CALLBACK_STATUS_SENDREQUEST_COMPLETE:
+            Job->Next([](HINTERNET Handle) { return WinHttpReceiveResponse(Handle, NULL); });
+            break;
+
+        case WINHTTP_CALLBACK_STATUS_HEADERS_AVAILABLE:
+            Job->Next([Job](HINTERNET Handle) {
+                DWORD Code = 0;
+                DWORD CodeSize = sizeof(Code);
+                if (!WinHttpQueryHeaders(Handle, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &Code,
+                                         &CodeSize, WINHTTP_NO_HEADER_INDEX) ||
+                    Code != 200) {
+                    return FALSE;
+                }
+                return WinHttpQueryDataAvailable(Handle, NULL);
+            });
+            break;
+
+        case WINHTTP_CALLBACK_STATUS_DATA_AVAILABLE: {
+            DWORD Available = *static_cast<DWORD*>(Info);
+            if (Available == 0) {
+                Job->Close(true);
+                break;
+            }
+            Job->Next([Job, Available](HINTERNET Handle) {
+                Job->Chunk.resize(Available);
+                return WinHttpReadData(Handle, Job->Chunk.data(), Available, NULL);
+            });
+            break;
+        }
+
+        case WINHTTP_CALLBACK_STATUS_READ_COMPLETE:
+            if (InfoLength == 0) {
+                Job->Close(true);
+                break;
+            }
+            // Outside Lock: OnData callbacks may cancel, which takes it.
+            Job->Request->Append({ Job->Chunk.data(), InfoLength });
+            Job->Received += InfoLength;
+            Job->Next([](HINTERNET Handle) { return WinHttpQueryDataAvailable(Handle, NULL); });
+            break;
+
+        case WINHTTP_CALLBACK_STATUS_REQUEST_ERROR:
+            Job->Close(false);
+            break;
+
+        case WINHTTP_CALLBACK_STATUS_HANDLE_CLOSING: {
+            Job->Request->ClearAbort();
+            Job->Request->Complete(Job->Ok && Job->Received > 0);
+            WinHttpFetcher& Owner = Job->Owner;
+            std::shared_ptr<Transfer> Last = std::move(Job->Self);
+            // Notified under the lock: the fetcher may be gone once it is released.
+            std::lock_guard<std::mutex> Guard(Owner.Lock);
+            Owner.Live.erase(Job);
+            Owner.Idle.notify_all();
+            break;
+        }
+        }
+    }
+};
+#endif
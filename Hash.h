@@ -0,0 +1,32 @@
+#pragma once
+
+#include <span>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit content hash for cache keys, eight bytes per step. Not
+// cryptographic; it only has to tell a few thousand textures apart.
+inline uint64_t HashBytes(std::span<const uint8_t> Data) {
+    constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+
+    uint64_t Hash = Prime2 ^ (Data.size() * Prime1);
+    size_t i = 0;
+    for (; i + 8 <= Data.size(); i += 8) {
+        uint64_t Word;
+        std::memcpy(&Word, Data.data() + i, sizeof(Word));
+        Hash = std::rotl(Hash ^ (Word * Prime2), 31) * Prime1;
+    }
+
+    uint64_t Tail = 0;
+    if (i < Data.size()) {
+        std::memcpy(&Tail, Data.data() + i, Data.size() - i);
+    }
+    Hash = std::rotl(Hash ^ (Tail * Prime2), 31) * Prime1;
+
+    Hash ^= Hash >> 33;
+    Hash *= Prime2;
+    Hash ^= Hash >> 29;
+    return Hash;
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include "Fetcher.h"
+#include "Socket.h"
+#include "ThreadPool.h"
+
+#ifndef _WIN32
+#include <netdb.h>
+#endif
+
+// Plain HTTP/1.1 for http:// URLs over blocking sockets, one transfer per
+// pool thread. Connections the server keeps alive go back to an idle list per
+// host for the next request. This is what the loopback stand-in server is
+// fetched with; TLS hosts need WinHttpFetcher.
+class HttpFetcher : public Fetcher {
+private:
+    // Cancel shuts the socket down from another thread, which fails the call
+    // in progress. The abort hook holds a reference, so the handle is only
+    // closed once no hook can still reach it, and its value can't have been
+    // reused by then.
+    struct Connection {
+        SocketHandle Socket;
+        std::string Key;
+
+        Connection(SocketHandle Socket, std::string Key) : Socket(Socket), Key(std::move(Key)) { }
+        ~Connection() {
+            CloseSocket(Socket);
+        }
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+    };
+
+    enum class Outcome {
+        // Nothing came back on a kept-alive connection the server had closed.
+        Stale,
+        Failed,
+        Done,
+        KeepAlive,
+    };
+
+    std::mutex Lock;
+    std::map<std::string, std::vector<std::shared_ptr<Connection>>> Idle;
+    std::set<std::shared_ptr<FetchRequest>> Live;
+    // Destroyed first, so no transfer outlives the members above.
+    WorkerPool Workers;
+
+public:
+    explicit HttpFetcher(int Threads = 4) : Workers(std::max(1, Threads)) {
+        if (!InitSockets()) {
+            throw std::runtime_error("Failed to initialize sockets");
+        }
+    }
+
+    // Cancels whatever is still downloading; Workers then waits for it.
+    ~HttpFetcher() {
+        std::set<std::shared_ptr<FetchRequest>> Pending;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Pending = Live;
+        }
+        for (auto& Request : Pending) {
+            Request->Cancel();
+        }
+    }
+
+    HttpFetcher(const HttpFetcher&) = delete;
+    HttpFetcher& operator=(const HttpFetcher&) = delete;
+
+    std::shared_ptr<FetchRequest> Fetch(const std::string& Url) override {
+        auto Request = std::make_shared<FetchRequest>();
+
+        const std::string Scheme = "http://";
+        if (Url.compare(0, Scheme.size(), Scheme) != 0) {
+            Request->Complete(false, {});
+            return Request;
+        }
+        size_t PathStart = Url.find('/', Scheme.size());
+        std::string Authority = Url.substr(Scheme.size(), PathStart - Scheme.size());
+        std::string Path = PathStart == std::string::npos ? "/" : Url.substr(PathStart);
+        if (Authority.empty()) {
+            Request->Complete(false, {});
+            return Request;
+        }
+
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Live.insert(Request);
+        }
+        Workers.Post([this, Request, Authority, Path] {
+            Request->Complete(Transfer(*Request, Authority, Path));
+            std::lock_guard<std::mutex> Guard(Lock);
+            Live.erase(Request);
+        });
+        return Request;
+    }
+
+    // Connections waiting for a next request, over every host.
+    size_t IdleConnections() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        size_t Count = 0;
+        for (const auto& [Key, List] : Idle) Count += List.size();
+        return Count;
+    }
+
+private:
+    // A kept-alive connection the server has since closed fails before any
+    // response; the request is then sent again on a new one.
+    bool Transfer(FetchRequest& Request, const std::string& Authority, const std::string& Path) {
+        for (bool Reused = true; !Request.IsCancelled();) {
+            std::shared_ptr<Connection> Link = Reused ? TakeIdle(Authority) : nullptr;
+            Reused = Link != nullptr;
+            if (!Link) Link = Connect(Authority);
+            if (!Link) return false;
+
+            if (!Request.SetAbort([Link] { ShutdownSocket(Link->Socket); })) return false;
+            Outcome Result = Exchange(*Link, Request, Authority, Path);
+            // False when Cancel shut the socket down, which then can't be reused.
+            bool Intact = Request.ClearAbort();
+
+            if (Result == Outcome::Stale && Reused && Intact) continue;
+            if (Result == Outcome::KeepAlive && Intact) {
+                std::lock_guard<std::mutex> Guard(Lock);
+                Idle[Link->Key].push_back(std::move(Link));
+            }
+            return Result == Outcome::Done || Result == Outcome::KeepAlive;
+        }
+        return false;
+    }
+
+    std::shared_ptr<Connection> TakeIdle(const std::string& Key) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto It = Idle.find(Key);
+        if (It == Idle.end() || It->second.empty()) return nullptr;
+        auto Link = std::move(It->second.back());
+        It->second.pop_back();
+        return Link;
+    }
+
+    static std::shared_ptr<Connection> Connect(const std::string& Authority) {
+        size_t Colon = Authority.rfind(':');
+        std::string Host = Authority.substr(0, Colon);
+        std::string Port = Colon == std::string::npos ? "80" : Authority.substr(Colon + 1);
+
+        addrinfo Hints = {};
+        Hints.ai_family = AF_UNSPEC;
+        Hints.ai_socktype = SOCK_STREAM;
+        Hints.ai_protocol = IPPROTO_TCP;
+        addrinfo* Found = nullptr;
+        if (getaddrinfo(Host.c_str(), Port.c_str(), &Hints, &Found) != 0) return nullptr;
+
+        SocketHandle Socket = InvalidSocket;
+        for (addrinfo* Address = Found; Address && Socket == InvalidSocket; Address = Address->ai_next) {
+            Socket = socket(Address->ai_family, Address->ai_socktype, Address->ai_protocol);
+            if (Socket == InvalidSocket) continue;
+            if (connect(Socket, Address->ai_addr, static_cast<int>(Address->ai_addrlen)) != 0) {
+                CloseSocket(Socket);
+                Socket = InvalidSocket;
+            }
+        }
+        freeaddrinfo(Found);
+        if (Socket == InvalidSocket) return nullptr;
+
+        int NoDelay = 1;
+        setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&NoDelay), sizeof(NoDelay));
+        return std::make_shared<Connection>(Socket, Authority);
+    }
+
+    // The value of header Name in Head, or empty.
+    static std::string HeaderValue(const std::string& Head, const std::string& Name) {
+        std::string Lower = Head;
+        std::transform(Lower.begin(), Lower.end(), Lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        size_t At = Lower.find("\r\n" + Name + ":");
+        if (At == std::string::npos) return {};
+        At += Name.size() + 3;
+        size_t End = Lower.find("\r\n", At);
+        std::string Value = Lower.substr(At, End == std::string::npos ? End : End - At);
+        Value.erase(0, Value.find_first_not_of(' '));
+        return Value;
+    }
+
+    // One GET. The body goes to Request a chunk at a time, as it arrives.
+    static Outcome Exchange(Connection& Link, FetchRequest& Request, const std::string& Authority, const std::string& Path) {
+        std::string Get = "GET " + Path + " HTTP/1.1\r\nHost: " + Authority + "\r\nConnection: keep-alive\r\n\r\n";
+        if (!SendAll(Link.Socket, Get.data(), Get.size())) return Outcome::Stale;
+
+        std::string Buffer;
+        char Chunk[16384];
+        size_t HeaderEnd;
+        while ((HeaderEnd = Buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (Buffer.size() > 65536) return Outcome::Failed;
+            int Received = recv(Link.Socket, Chunk, sizeof(Chunk), 0);
+            if (Received <= 0) return Buffer.empty() ? Outcome::Stale : Outcome::Failed;
+            Buffer.append(Chunk, Received);
+        }
+
+        std::string Head = Buffer.substr(0, HeaderEnd);
+        Buffer.erase(0, HeaderEnd + 4);
+        if (Head.compare(0, 9, "HTTP/1.1 ") != 0 || Head.compare(9, 3, "200") != 0) return Outcome::Failed;
+        // Chunked bodies aren't needed for texture files.
+        if (HeaderValue(Head, "transfer-encoding").size() > 0) return Outcome::Failed;
+
+        std::string Length = HeaderValue(Head, "content-length");
+        bool KnownLength = !Length.empty();
+        size_t Remaining = KnownLength ? std::strtoull(Length.c_str(), nullptr, 10) : SIZE_MAX;
+        bool Close = HeaderValue(Head, "connection") == "close";
+
+        // Bytes past the body would belong to a response never asked for.
+        if (Buffer.size() > Remaining) return Outcome::Failed;
+        size_t Received = Buffer.size();
+        if (!Buffer.empty()) {
+            Request.Append({ reinterpret_cast<const uint8_t*>(Buffer.data()), Buffer.size() });
+            Remaining -= Buffer.size();
+        }
+        while (Remaining > 0) {
+            if (Request.IsCancelled()) return Outcome::Failed;
+            int Count = recv(Link.Socket, Chunk, static_cast<int>(std::min(sizeof(Chunk), Remaining)), 0);
+            if (Count <= 0) {
+                // Without a length the body runs until the server closes.
+                return !KnownLength && Count == 0 && Received > 0 ? Outcome::Done : Outcome::Failed;
+            }
+            Request.Append({ reinterpret_cast<const uint8_t*>(Chunk), static_cast<size_t>(Count) });
+            Received += Count;
+            Remaining -= Count;
+        }
+        if (Received == 0) return Outcome::Failed;
+        return KnownLength && !Close ? Outcome::KeepAlive : Outcome::Done;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "Socket.h"
+
+// Minimal HTTP/1.1 server on 127.0.0.1 that serves in-memory files with
+// keep-alive, standing in for the captcha CDN when testing fetchers offline.
+class LoopbackServer {
+private:
+    SocketHandle Listener = InvalidSocket;
+    uint16_t Port = 0;
+    std::thread Acceptor;
+    std::mutex Lock;
+    std::map<std::string, std::vector<uint8_t>> Files;
+    std::vector<SocketHandle> Clients;
+    std::vector<std::thread> Handlers;
+    std::atomic<bool> Running{ true };
+    std::atomic<int> RequestCount{ 0 };
+    std::atomic<int> ConnectionCount{ 0 };
+
+public:
+    LoopbackServer() {
+        if (!InitSockets()) {
+            throw std::runtime_error("Failed to initialize sockets");
+        }
+
+        Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in Address = {};
+        Address.sin_family = AF_INET;
+        Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        Address.sin_port = 0;
+        socklen_t Length = sizeof(Address);
+        if (Listener == InvalidSocket ||
+            bind(Listener, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0 ||
+            listen(Listener, SOMAXCONN) != 0 ||
+            getsockname(Listener, reinterpret_cast<sockaddr*>(&Address), &Length) != 0) {
+            if (Listener != InvalidSocket) CloseSocket(Listener);
+            throw std::runtime_error("Failed to start loopback server");
+        }
+        Port = ntohs(Address.sin_port);
+
+        Acceptor = std::thread([this] {
+            for (;;) {
+                SocketHandle Client = accept(Listener, nullptr, nullptr);
+                if (Client == InvalidSocket) {
+                    if (!Running) return;
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> Guard(Lock);
+                if (!Running) {
+                    CloseSocket(Client);
+                    return;
+                }
+                ++ConnectionCount;
+                Clients.push_back(Client);
+                Handlers.emplace_back([this, Client] { Handle(Client); });
+            }
+        });
+    }
+
+    ~LoopbackServer() {
+        Running = false;
+        ShutdownSocket(Listener);
+        CloseSocket(Listener);
+        Acceptor.join();
+
+        // Handlers only read Clients under the lock, so they can't race this.
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            for (SocketHandle Client : Clients) {
+                ShutdownSocket(Client);
+            }
+        }
+        for (auto& Handler : Handlers) {
+            Handler.join();
+        }
+        for (SocketHandle Client : Clients) {
+            CloseSocket(Client);
+        }
+    }
+
+    LoopbackServer(const LoopbackServer&) = delete;
+    LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+    void Serve(const std::string& Path, std::vector<uint8_t> Body) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Files[Path] = std::move(Body);
+    }
+
+    // "127.0.0.1:port", usable wherever the solver expects a host.
+    std::string Host() const {
+        return "127.0.0.1:" + std::to_string(Port);
+    }
+
+    int Requests() const {
+        return RequestCount;
+    }
+
+    int Connections() const {
+        return ConnectionCount;
+    }
+
+private:
+    void Handle(SocketHandle Client) {
+        Respond(Client);
+        // The handle itself stays open until the destructor, so it can't be reused under us.
+        ShutdownSocket(Client);
+    }
+
+    void Respond(SocketHandle Client) {
+        std::string Buffer;
+        char Chunk[4096];
+
+        while (Running) {
+            size_t HeaderEnd;
+            while ((HeaderEnd = Buffer.find("\r\n\r\n")) == std::string::npos) {
+                int Received = recv(Client, Chunk, sizeof(Chunk), 0);
+                if (Received <= 0) return;
+                Buffer.append(Chunk, Received);
+            }
+
+            std::string Head = Buffer.substr(0, HeaderEnd);
+            Buffer.erase(0, HeaderEnd + 4);
+            ++RequestCount;
+
+            size_t PathStart = Head.find(' ');
+            size_t PathEnd = PathStart == std::string::npos ? PathStart : Head.find(' ', PathStart + 1);
+            std::string Path = PathEnd == std::string::npos ? "" : Head.substr(PathStart + 1, PathEnd - PathStart - 1);
+            bool Close = Head.find("Connection: close") != std::string::npos;
+
+            std::vector<uint8_t> Body;
+            bool Found;
+            {
+                std::lock_guard<std::mutex> Guard(Lock);
+                auto It = Files.find(Path);
+                Found = It != Files.end();
+                if (Found) Body = It->second;
+            }
+
+            std::string Response = std::string(Found ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found") +
+                                   "\r\nContent-Type: application/octet-stream\r\nContent-Length: " + std::to_string(Body.size()) +
+                                   (Close ? "\r\nConnection: close" : "\r\nConnection: keep-alive") + "\r\n\r\n";
+            if (!SendAll(Client, Response.data(), Response.size()) || !SendAll(Client, Body.data(), Body.size()) || Close) {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. The mapping lives as long as the object.
+class MappedFile {
+private:
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+#ifdef _WIN32
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const char* Path) {
+#ifdef _WIN32
+        File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (File == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open file");
+        }
+
+        LARGE_INTEGER FileSize;
+        if (!GetFileSizeEx(File, &FileSize)) {
+            CloseHandle(File);
+            throw std::runtime_error("Failed to open file");
+        }
+
+        Size = static_cast<size_t>(FileSize.QuadPart);
+        if (Size == 0) return;
+
+        Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (Mapping) {
+            Data = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (!Data) {
+            if (Mapping) CloseHandle(Mapping);
+            CloseHandle(File);
+            throw std::runtime_error("Failed to map file");
+        }
+#else
+        int fd = open(Path, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to open file");
+        }
+
+        Size = static_cast<size_t>(st.st_size);
+        if (Size != 0) {
+            void* View = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (View == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Failed to map file");
+            }
+            Data = static_cast<const uint8_t*>(View);
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (Data) UnmapViewOfFile(Data);
+        if (Mapping) CloseHandle(Mapping);
+        if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+#else
+        if (Data) munmap(const_cast<uint8_t*>(Data), Size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const uint8_t> GetData() const {
+        return { Data, Size };
+    }
+};
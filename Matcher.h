@@ -0,0 +1,451 @@
+#pragma once
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include "BitMap.h"
+#include "PixelFormat.h"
+#include "Simd.h"
+
+inline bool isNearEquation(const RGB_A& Original, const RGB_A& Color, int Tolerance = 2) {
+    return std::abs(Original.r - Color.r) <= Tolerance &&
+           std::abs(Original.g - Color.g) <= Tolerance &&
+           std::abs(Original.b - Color.b) <= Tolerance;
+}
+
+// The inner window of a MakeSquare output, cut down to the pixels a match has
+// to cover. A position matches when the first Count pixels of the window, in
+// raster order, are all within Tolerance of the background.
+struct PieceTemplate {
+    static constexpr int Border = 12;
+    static constexpr int MatchPixels = 201;
+    static constexpr int SampleRows = 2;
+    static constexpr int SampleColumns = 6;
+
+    struct Sample {
+        int x, y;
+    };
+
+    int Width = 0;
+    int Rows = 0;
+    int Count = 0;
+    int Tolerance = 2;
+    std::vector<uint32_t> Pixels;
+    // Luma of each pixel, for LumaScanner.
+    std::vector<uint8_t> Luma;
+    // A few high-contrast window pixels, checked before the dense rows so
+    // most false starts fail after a handful of compares. Every sample is one
+    // of the Count pixels, so the result doesn't change.
+    std::vector<Sample> Samples;
+
+    PieceTemplate() = default;
+
+    // HasAlpha says the square's alpha byte is real, and transparent pixels
+    // are then never picked as samples.
+    explicit PieceTemplate(BitMap& Square, bool HasAlpha = true) {
+        int InnerWidth = Square.Width - Border * 2;
+        int InnerHeight = Square.Height - Border * 2;
+        if (InnerWidth <= 0 || InnerHeight <= 0 || InnerWidth * InnerHeight < MatchPixels) {
+            return;
+        }
+
+        std::vector<uint32_t> Window(MatchPixels);
+        for (int i = 0; i < MatchPixels; ++i) {
+            std::memcpy(&Window[i], Square.GetBitData(Border + i % InnerWidth, Border + i / InnerWidth), sizeof(uint32_t));
+        }
+        *this = PieceTemplate(InnerWidth, std::move(Window), 2);
+        PickSamples(HasAlpha);
+    }
+
+    PieceTemplate(int Width, std::vector<uint32_t> Window, int Tolerance)
+        : Width(Width), Rows((static_cast<int>(Window.size()) + Width - 1) / Width),
+          Count(static_cast<int>(Window.size())), Tolerance(Tolerance), Pixels(std::move(Window)), Luma(Count) {
+        LumaRow(reinterpret_cast<const RGB_A*>(Pixels.data()), Luma.data(), Count);
+    }
+
+    bool Valid() const {
+        return Count > 0;
+    }
+
+    int RowLength(int Row) const {
+        return std::min(Width, Count - Row * Width);
+    }
+
+private:
+    // Scores each pixel by its r/g/b gradient to the right and down neighbours
+    // and keeps the best one per cell of a SampleRows x SampleColumns grid, so
+    // the samples are spread over the window. Pixel 0 is the scan's gate and
+    // flat cells have nothing to offer, so neither is kept.
+    void PickSamples(bool HasAlpha) {
+        auto Channel = [this](int i, int c) {
+            return static_cast<int>(reinterpret_cast<const uint8_t*>(&Pixels[i])[c]);
+        };
+        auto Score = [&](int i) {
+            if (HasAlpha && Channel(i, 2) == 0) return 0;
+            int Total = 0;
+            for (int Neighbour : { i + 1, i + Width }) {
+                if (Neighbour >= Count || (Neighbour == i + 1 && Neighbour % Width == 0)) continue;
+                for (int c : { 0, 1, 3 }) {
+                    Total += std::abs(Channel(i, c) - Channel(Neighbour, c));
+                }
+            }
+            return Total;
+        };
+
+        std::vector<std::pair<int, int>> Best(SampleRows * SampleColumns, { 0, 0 });
+        for (int i = 1; i < Count; ++i) {
+            int Cell = (i / Width) * SampleRows / Rows * SampleColumns + (i % Width) * SampleColumns / Width;
+            int s = Score(i);
+            if (s > Best[Cell].first) {
+                Best[Cell] = { s, i };
+            }
+        }
+
+        std::sort(Best.begin(), Best.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (const auto& [s, i] : Best) {
+            if (s > 0) {
+                Samples.push_back({ i % Width, i / Width });
+            }
+        }
+    }
+};
+
+// Each kernel scans candidate origins [0, XEnd) of one background row and
+// returns the first one whose window matches, or -1. Window rows are read at
+// Stride pixel steps from the candidate, exactly like the original
+// GetPixelRGBA(X + x, Y + y) walk, so a window may wrap onto the next row.
+struct MatchScalar {
+    static bool Near(const uint32_t* Image, const uint32_t* Template, int Tolerance) {
+        RGB_A a, b;
+        std::memcpy(&a, reinterpret_cast<const uint8_t*>(Image), sizeof(a));
+        std::memcpy(&b, reinterpret_cast<const uint8_t*>(Template), sizeof(b));
+        return isNearEquation(a, b, Tolerance);
+    }
+
+    static bool CheckSamples(const uint32_t* Image, int Stride, const PieceTemplate& Template) {
+        for (const auto& Sample : Template.Samples) {
+            if (!Near(Image + Sample.y * Stride + Sample.x, &Template.Pixels[Sample.y * Template.Width + Sample.x], Template.Tolerance)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool Verify(const uint32_t* Image, int Stride, const PieceTemplate& Template) {
+        if (!CheckSamples(Image, Stride, Template)) return false;
+
+        const uint32_t* Expected = Template.Pixels.data();
+        for (int Row = 0; Row < Template.Rows; ++Row) {
+            int Count = Template.RowLength(Row);
+            for (int i = 0; i < Count; ++i) {
+                if (!Near(Image + i, Expected + i, Template.Tolerance)) return false;
+            }
+            Image += Stride;
+            Expected += Count;
+        }
+        return true;
+    }
+
+    static int FindInRow(const uint32_t* Image, int XEnd, int Stride, const PieceTemplate& Template) {
+        for (int X = 0; X < XEnd; ++X) {
+            if (Near(Image + X, Template.Pixels.data(), Template.Tolerance) && Verify(Image + X, Stride, Template)) {
+                return X;
+            }
+        }
+        return -1;
+    }
+};
+
+#ifdef SIMD_X86
+// Per-byte |a - b| via saturating subtracts, alpha masked off, then anything
+// above 2 is left non-zero. A zero lane is a pixel within tolerance.
+struct MatchSSE41 {
+    SIMD_TARGET("sse4.1")
+    static __m128i Excess(__m128i a, __m128i b, __m128i Tolerance) {
+        const __m128i Channels = _mm_set1_epi32(static_cast<int>(0xFF00FFFF));
+        __m128i Diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        return _mm_subs_epu8(_mm_and_si128(Diff, Channels), Tolerance);
+    }
+
+    SIMD_TARGET("sse4.1")
+    static bool Verify(const uint32_t* Image, int Stride, const PieceTemplate& Template) {
+        if (!MatchScalar::CheckSamples(Image, Stride, Template)) return false;
+
+        const __m128i Tolerance = _mm_set1_epi8(static_cast<char>(Template.Tolerance));
+        const uint32_t* Expected = Template.Pixels.data();
+        for (int Row = 0; Row < Template.Rows; ++Row) {
+            int Count = Template.RowLength(Row);
+            if (Count < 4) {
+                for (int i = 0; i < Count; ++i) {
+                    if (!MatchScalar::Near(Image + i, Expected + i, Template.Tolerance)) return false;
+                }
+            } else {
+                // The last load overlaps the previous one instead of a scalar tail.
+                for (int i = 0; i < Count; i += 4) {
+                    int At = std::min(i, Count - 4);
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Image + At));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Expected + At));
+                    __m128i e = Excess(a, b, Tolerance);
+                    if (!_mm_testz_si128(e, e)) return false;
+                }
+            }
+            Image += Stride;
+            Expected += Count;
+        }
+        return true;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static int FindInRow(const uint32_t* Image, int XEnd, int Stride, const PieceTemplate& Template) {
+        const __m128i First = _mm_set1_epi32(static_cast<int>(Template.Pixels[0]));
+        const __m128i Tolerance = _mm_set1_epi8(static_cast<char>(Template.Tolerance));
+        int X = 0;
+        for (; X + 4 <= XEnd; X += 4) {
+            __m128i e = Excess(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Image + X)), First, Tolerance);
+            unsigned Mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(e, _mm_setzero_si128())));
+            for (; Mask; Mask &= Mask - 1) {
+                int Candidate = X + std::countr_zero(Mask);
+                if (Verify(Image + Candidate, Stride, Template)) return Candidate;
+            }
+        }
+        for (; X < XEnd; ++X) {
+            if (MatchScalar::Near(Image + X, Template.Pixels.data(), Template.Tolerance) && Verify(Image + X, Stride, Template)) {
+                return X;
+            }
+        }
+        return -1;
+    }
+};
+
+struct MatchAVX2 {
+    SIMD_TARGET("avx2")
+    static __m256i Excess(__m256i a, __m256i b, __m256i Tolerance) {
+        const __m256i Channels = _mm256_set1_epi32(static_cast<int>(0xFF00FFFF));
+        __m256i Diff = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+        return _mm256_subs_epu8(_mm256_and_si256(Diff, Channels), Tolerance);
+    }
+
+    SIMD_TARGET("avx2")
+    static bool Verify(const uint32_t* Image, int Stride, const PieceTemplate& Template) {
+        if (!MatchScalar::CheckSamples(Image, Stride, Template)) return false;
+
+        const __m256i Tolerance = _mm256_set1_epi8(static_cast<char>(Template.Tolerance));
+        const uint32_t* Expected = Template.Pixels.data();
+        for (int Row = 0; Row < Template.Rows; ++Row) {
+            int Count = Template.RowLength(Row);
+            if (Count < 8) {
+                for (int i = 0; i < Count; ++i) {
+                    if (!MatchScalar::Near(Image + i, Expected + i, Template.Tolerance)) return false;
+                }
+            } else {
+                for (int i = 0; i < Count; i += 8) {
+                    int At = std::min(i, Count - 8);
+                    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Image + At));
+                    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Expected + At));
+                    __m256i e = Excess(a, b, Tolerance);
+                    if (!_mm256_testz_si256(e, e)) return false;
+                }
+            }
+            Image += Stride;
+            Expected += Count;
+        }
+        return true;
+    }
+
+    SIMD_TARGET("avx2")
+    static int FindInRow(const uint32_t* Image, int XEnd, int Stride, const PieceTemplate& Template) {
+        const __m256i First = _mm256_set1_epi32(static_cast<int>(Template.Pixels[0]));
+        const __m256i Tolerance = _mm256_set1_epi8(static_cast<char>(Template.Tolerance));
+        int X = 0;
+        for (; X + 8 <= XEnd; X += 8) {
+            __m256i e = Excess(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(Image + X)), First, Tolerance);
+            unsigned Mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(e, _mm256_setzero_si256())));
+            for (; Mask; Mask &= Mask - 1) {
+                int Candidate = X + std::countr_zero(Mask);
+                if (Verify(Image + Candidate, Stride, Template)) return Candidate;
+            }
+        }
+        for (; X < XEnd; ++X) {
+            if (MatchScalar::Near(Image + X, Template.Pixels.data(), Template.Tolerance) && Verify(Image + X, Stride, Template)) {
+                return X;
+            }
+        }
+        return -1;
+    }
+};
+#endif
+
+using FindInRowFn = int (*)(const uint32_t* Image, int XEnd, int Stride, const PieceTemplate& Template);
+
+inline FindInRowFn GetMatchKernel() {
+#ifdef SIMD_X86
+    const CpuFeatures& Cpu = CpuFeatures::Get();
+    if (Cpu.AVX2) return MatchAVX2::FindInRow;
+    if (Cpu.SSE41) return MatchSSE41::FindInRow;
+#endif
+    return MatchScalar::FindInRow;
+}
+
+// Finds matching origins one background row at a time over columns
+// [0, XLimit). Origins whose window would run past the end of the bitmap are
+// skipped rather than read out of bounds.
+class PieceScanner {
+private:
+    const uint32_t* Pixels;
+    const PieceTemplate& Template;
+    FindInRowFn Kernel;
+    long long Total;
+    long long Reach = 0;
+    int Width;
+    int XLimit;
+
+public:
+    PieceScanner(BitMap& Image, int XLimit, const PieceTemplate& Template, FindInRowFn Kernel = GetMatchKernel())
+        : Pixels(reinterpret_cast<const uint32_t*>(Image.GetBitData())), Template(Template), Kernel(Kernel),
+          Total(static_cast<long long>(Image.Width) * Image.Height), Width(Image.Width), XLimit(XLimit) {
+        for (int Row = 0; Row < Template.Rows; ++Row) {
+            Reach = std::max(Reach, static_cast<long long>(Row) * Width + Template.RowLength(Row));
+        }
+    }
+
+    // One past the last origin of row Y that is searched.
+    int End(int Y) const {
+        long long Last = static_cast<long long>(Y) * Width + Reach;
+        return static_cast<int>(std::max<long long>(0, std::min<long long>(XLimit, Total - Last + 1)));
+    }
+
+    // First match in row Y at or after XBegin, or -1.
+    int Find(int Y, int XBegin) const {
+        if (!Template.Valid()) return -1;
+
+        int XEnd = End(Y);
+        if (XEnd <= XBegin) return -1;
+
+        int X = Kernel(Pixels + static_cast<size_t>(Y) * Width + XBegin, XEnd - XBegin, Width, Template);
+        return X >= 0 ? XBegin + X : -1;
+    }
+
+    bool Matches(int X, int Y) const {
+        if (!Template.Valid() || X < 0 || X >= End(Y)) return false;
+
+        return Kernel(Pixels + static_cast<size_t>(Y) * Width + X, 1, Width, Template) == 0;
+    }
+
+    int operator()(int Y) const {
+        return Find(Y, 0);
+    }
+};
+
+// Index of the first byte of Row[0, Count) within Tolerance of Target, or -1.
+using LumaFindFn = int (*)(const uint8_t* Row, int Count, uint8_t Target, int Tolerance);
+
+inline int LumaFindScalar(const uint8_t* Row, int Count, uint8_t Target, int Tolerance) {
+    for (int x = 0; x < Count; ++x) {
+        if (std::abs(Row[x] - Target) <= Tolerance) return x;
+    }
+    return -1;
+}
+
+#ifdef SIMD_X86
+inline int LumaFindSSE2(const uint8_t* Row, int Count, uint8_t Target, int Tolerance) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(Target));
+    const __m128i Tol = _mm_set1_epi8(static_cast<char>(Tolerance));
+    int x = 0;
+    for (; x + 16 <= Count; x += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Row + x));
+        __m128i Diff = _mm_or_si128(_mm_subs_epu8(v, t), _mm_subs_epu8(t, v));
+        unsigned Mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(Diff, Tol), _mm_setzero_si128()));
+        if (Mask) return x + std::countr_zero(Mask);
+    }
+    int Tail = LumaFindScalar(Row + x, Count - x, Target, Tolerance);
+    return Tail >= 0 ? x + Tail : -1;
+}
+
+SIMD_TARGET("avx2")
+inline int LumaFindAVX2(const uint8_t* Row, int Count, uint8_t Target, int Tolerance) {
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(Target));
+    const __m256i Tol = _mm256_set1_epi8(static_cast<char>(Tolerance));
+    int x = 0;
+    for (; x + 32 <= Count; x += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Row + x));
+        __m256i Diff = _mm256_or_si256(_mm256_subs_epu8(v, t), _mm256_subs_epu8(t, v));
+        unsigned Mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(Diff, Tol), _mm256_setzero_si256())));
+        if (Mask) return x + std::countr_zero(Mask);
+    }
+    int Tail = LumaFindSSE2(Row + x, Count - x, Target, Tolerance);
+    return Tail >= 0 ? x + Tail : -1;
+}
+#endif
+
+inline LumaFindFn GetLumaKernel() {
+#ifdef SIMD_X86
+    return CpuFeatures::Get().AVX2 ? LumaFindAVX2 : LumaFindSSE2;
+#else
+    return LumaFindScalar;
+#endif
+}
+
+// PieceScanner that first screens origins on the image's luma plane, one byte
+// per pixel instead of four. r, g and b each within Tolerance keep the 8.8
+// fixed-point luma within Tolerance as well, so screening never drops a real
+// match; survivors of the first pixel and sample checks are verified in full.
+class LumaScanner {
+private:
+    PieceScanner Full;
+    const uint32_t* Pixels;
+    const uint8_t* Plane;
+    const PieceTemplate& Template;
+    LumaFindFn Kernel;
+    int Width;
+
+public:
+    LumaScanner(BitMap& Image, LumaPlane& Luma, int XLimit, const PieceTemplate& Template, LumaFindFn Kernel = GetLumaKernel())
+        : Full(Image, XLimit, Template), Pixels(reinterpret_cast<const uint32_t*>(Image.GetBitData())), Plane(Luma.GetBitData()), Template(Template), Kernel(Kernel), Width(Image.Width) { }
+
+    int Find(int Y, int XBegin) const {
+        if (!Template.Valid()) return -1;
+
+        int XEnd = Full.End(Y);
+        const uint8_t* Row = Plane + static_cast<size_t>(Y) * Width;
+        for (int X = XBegin; X < XEnd; ++X) {
+            int Next = Kernel(Row + X, XEnd - X, Template.Luma[0], Template.Tolerance);
+            if (Next < 0) return -1;
+            X += Next;
+            if (MatchScalar::Near(Pixels + static_cast<size_t>(Y) * Width + X, Template.Pixels.data(), Template.Tolerance) &&
+                Samples(Row + X) && Full.Matches(X, Y)) {
+                return X;
+            }
+        }
+        return -1;
+    }
+
+    int operator()(int Y) const {
+        return Find(Y, 0);
+    }
+
+private:
+    bool Samples(const uint8_t* Origin) const {
+        for (const auto& Sample : Template.Samples) {
+            int Expected = Template.Luma[Sample.y * Template.Width + Sample.x];
+            if (std::abs(Origin[Sample.y * Width + Sample.x] - Expected) > Template.Tolerance) return false;
+        }
+        return true;
+    }
+};
+
+// First matching origin in raster order over rows [YBegin, YEnd).
+inline bool FindPiece(BitMap& Image, int XLimit, int YBegin, int YEnd, const PieceTemplate& Template, int& OutX, int& OutY, FindInRowFn Kernel = GetMatchKernel()) {
+    PieceScanner Scanner(Image, XLimit, Template, Kernel);
+    for (int Y = YBegin; Y < YEnd; ++Y) {
+        int X = Scanner(Y);
+        if (X >= 0) {
+            OutX = X;
+            OutY = Y;
+            return true;
+        }
+    }
+    return false;
+}
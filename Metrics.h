@@ -0,0 +1,281 @@
+#pragma once
+
+#include <bit>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+enum class SolveStage {
+    FetchBackground,
+    FetchPiece,
+    Decode,
+    GetAnswer,
+    MakeSquare,
+    Match,
+    Reply,
+    Count
+};
+
+enum class SolveCounter {
+    // Dialogs handed to the solver.
+    Solves,
+    // No reply: bad dialog, failed download or undecodable texture.
+    Failures,
+    // Answered from the white bar alone.
+    WhiteBar,
+    // Needed the piece because there was no white bar.
+    PieceFallbacks,
+    // Replied with 0, i.e. the piece wasn't found either.
+    ZeroAnswers,
+    // Answered from the shared answer cache without decoding.
+    CachedAnswers,
+    Count
+};
+
+inline const char* StageName(SolveStage Stage) {
+    static const char* Names[] = { "fetch_background", "fetch_piece", "decode", "get_answer", "make_square", "match", "reply" };
+    return Names[static_cast<int>(Stage)];
+}
+
+inline const char* CounterName(SolveCounter Counter) {
+    static const char* Names[] = { "solves", "failures", "white_bar", "piece_fallbacks", "zero_answers", "cached_answers" };
+    return Names[static_cast<int>(Counter)];
+}
+
+// Log-linear buckets over nanoseconds, HDR histogram style. Values below
+// SubCount get a bucket each; above that every power of two is split into
+// SubCount buckets, so a bucket is never wider than 1/SubCount of its values.
+struct LatencyBuckets {
+    static constexpr int SubBits = 4;
+    static constexpr int SubCount = 1 << SubBits;
+    static constexpr int Count = (64 - SubBits + 1) * SubCount;
+
+    static int Index(uint64_t Value) {
+        if (Value < SubCount) return static_cast<int>(Value);
+        int Shift = std::bit_width(Value) - 1 - SubBits;
+        return (Shift + 1) * SubCount + static_cast<int>((Value >> Shift) & (SubCount - 1));
+    }
+
+    // Smallest value that lands in bucket Index.
+    static uint64_t Lower(int Index) {
+        if (Index < SubCount) return Index;
+        int Shift = Index / SubCount - 1;
+        return static_cast<uint64_t>(SubCount + Index % SubCount) << Shift;
+    }
+
+    // Middle of bucket Index, used when reporting.
+    static uint64_t Middle(int Index) {
+        if (Index < SubCount) return Index;
+        return Lower(Index) + (uint64_t(1) << (Index / SubCount - 1)) / 2;
+    }
+};
+
+// One thread's counts. Only the owning thread writes, so updates are a
+// relaxed load and store rather than a locked add; readers may see a count
+// from just before the latest update.
+struct MetricsShard {
+    static constexpr int Stages = static_cast<int>(SolveStage::Count);
+    static constexpr int Counters = static_cast<int>(SolveCounter::Count);
+
+    std::array<std::array<std::atomic<uint64_t>, LatencyBuckets::Count>, Stages> Buckets{};
+    std::array<std::atomic<uint64_t>, Stages> TotalNanos{};
+    std::array<std::atomic<uint64_t>, Stages> MaxNanos{};
+    std::array<std::atomic<uint64_t>, Counters> Counts{};
+
+    static void Add(std::atomic<uint64_t>& Value, uint64_t Amount) {
+        Value.store(Value.load(std::memory_order_relaxed) + Amount, std::memory_order_relaxed);
+    }
+};
+
+struct MetricsSnapshot {
+    static constexpr int Stages = MetricsShard::Stages;
+    static constexpr int Counters = MetricsShard::Counters;
+
+    std::array<std::array<uint64_t, LatencyBuckets::Count>, Stages> Buckets{};
+    std::array<uint64_t, Stages> TotalNanos{};
+    std::array<uint64_t, Stages> MaxNanos{};
+    std::array<uint64_t, Counters> Counts{};
+
+    uint64_t Samples(SolveStage Stage) const {
+        uint64_t Total = 0;
+        for (uint64_t n : Buckets[static_cast<int>(Stage)]) Total += n;
+        return Total;
+    }
+
+    double MeanMs(SolveStage Stage) const {
+        uint64_t n = Samples(Stage);
+        return n ? TotalNanos[static_cast<int>(Stage)] / 1e6 / n : 0.0;
+    }
+
+    double MaxMs(SolveStage Stage) const {
+        return MaxNanos[static_cast<int>(Stage)] / 1e6;
+    }
+
+    // Latency at Quantile (0..1), accurate to the bucket width.
+    double PercentileMs(SolveStage Stage, double Quantile) const {
+        const auto& Histogram = Buckets[static_cast<int>(Stage)];
+        uint64_t n = Samples(Stage);
+        if (!n) return 0.0;
+
+        uint64_t Rank = static_cast<uint64_t>(Quantile * (n - 1)) + 1;
+        uint64_t Seen = 0;
+        for (int i = 0; i < LatencyBuckets::Count; ++i) {
+            Seen += Histogram[i];
+            if (Seen >= Rank) return LatencyBuckets::Middle(i) / 1e6;
+        }
+        return MaxMs(Stage);
+    }
+
+    uint64_t Count(SolveCounter Counter) const {
+        return Counts[static_cast<int>(Counter)];
+    }
+
+    // Counter as a fraction of Solves.
+    double Rate(SolveCounter Counter) const {
+        uint64_t Solves = Count(SolveCounter::Solves);
+        return Solves ? static_cast<double>(Count(Counter)) / Solves : 0.0;
+    }
+
+    // One line per stage that has samples, then the counters.
+    std::string Format() const {
+        std::string Out;
+        char Line[256];
+        for (int s = 0; s < Stages; ++s) {
+            SolveStage Stage = static_cast<SolveStage>(s);
+            if (!Samples(Stage)) continue;
+            snprintf(Line, sizeof(Line), "%-16s n=%llu mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f ms\n", StageName(Stage),
+                     static_cast<unsigned long long>(Samples(Stage)), MeanMs(Stage), PercentileMs(Stage, 0.5), PercentileMs(Stage, 0.9),
+                     PercentileMs(Stage, 0.99), MaxMs(Stage));
+            Out += Line;
+        }
+        for (int c = 0; c < Counters; ++c) {
+            SolveCounter Counter = static_cast<SolveCounter>(c);
+            snprintf(Line, sizeof(Line), "%-16s %llu (%.1f%%)\n", CounterName(Counter), static_cast<unsigned long long>(Count(Counter)),
+                     Rate(Counter) * 100.0);
+            Out += Line;
+        }
+        return Out;
+    }
+};
+
+// Process-wide solver metrics. Each thread records into its own shard, so
+// recording never takes a lock or shares a cache line with another thread;
+// Snapshot sums the shards. A thread's shard goes back on a free list when the
+// thread exits and the next new thread records on into it, so nothing recorded
+// is lost and there are only as many shards as threads that recorded at once.
+class SolverMetrics {
+private:
+    // Hands the thread's shard back when the thread exits.
+    struct ShardOwner {
+        SolverMetrics* Metrics = nullptr;
+        MetricsShard* Shard = nullptr;
+
+        ~ShardOwner() {
+            if (Shard) Metrics->Release(Shard);
+            Shard = nullptr;
+        }
+    };
+
+    std::mutex Lock;
+    std::vector<std::unique_ptr<MetricsShard>> Shards;
+    std::vector<MetricsShard*> Free;
+
+    MetricsShard& Local() {
+        thread_local ShardOwner Owner;
+        if (!Owner.Shard) {
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (Free.empty()) {
+                Shards.push_back(std::make_unique<MetricsShard>());
+                Free.push_back(Shards.back().get());
+            }
+            Owner.Metrics = this;
+            Owner.Shard = Free.back();
+            Free.pop_back();
+        }
+        return *Owner.Shard;
+    }
+
+    void Release(MetricsShard* Shard) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Free.push_back(Shard);
+    }
+
+public:
+    // Never destroyed, so threads may record during static destruction.
+    static SolverMetrics& Get() {
+        static SolverMetrics* Instance = new SolverMetrics();
+        return *Instance;
+    }
+
+    void Record(SolveStage Stage, std::chrono::nanoseconds Elapsed) {
+        MetricsShard& Shard = Local();
+        int s = static_cast<int>(Stage);
+        uint64_t Nanos = static_cast<uint64_t>(std::max<int64_t>(0, Elapsed.count()));
+        MetricsShard::Add(Shard.Buckets[s][LatencyBuckets::Index(Nanos)], 1);
+        MetricsShard::Add(Shard.TotalNanos[s], Nanos);
+        if (Nanos > Shard.MaxNanos[s].load(std::memory_order_relaxed)) {
+            Shard.MaxNanos[s].store(Nanos, std::memory_order_relaxed);
+        }
+    }
+
+    void Count(SolveCounter Counter, uint64_t Amount = 1) {
+        MetricsShard::Add(Local().Counts[static_cast<int>(Counter)], Amount);
+    }
+
+    MetricsSnapshot Snapshot() {
+        MetricsSnapshot Out;
+        std::lock_guard<std::mutex> Guard(Lock);
+        for (const auto& Shard : Shards) {
+            for (int s = 0; s < MetricsSnapshot::Stages; ++s) {
+                for (int i = 0; i < LatencyBuckets::Count; ++i) {
+                    Out.Buckets[s][i] += Shard->Buckets[s][i].load(std::memory_order_relaxed);
+                }
+                Out.TotalNanos[s] += Shard->TotalNanos[s].load(std::memory_order_relaxed);
+                Out.MaxNanos[s] = std::max(Out.MaxNanos[s], Shard->MaxNanos[s].load(std::memory_order_relaxed));
+            }
+            for (int c = 0; c < MetricsSnapshot::Counters; ++c) {
+                Out.Counts[c] += Shard->Counts[c].load(std::memory_order_relaxed);
+            }
+        }
+        return Out;
+    }
+
+    // Zeroes every shard. Updates racing with it may survive or be lost.
+    void Reset() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        for (const auto& Shard : Shards) {
+            for (auto& Histogram : Shard->Buckets) {
+                for (auto& Bucket : Histogram) Bucket.store(0, std::memory_order_relaxed);
+            }
+            for (auto& Total : Shard->TotalNanos) Total.store(0, std::memory_order_relaxed);
+            for (auto& Max : Shard->MaxNanos) Max.store(0, std::memory_order_relaxed);
+            for (auto& Count : Shard->Counts) Count.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Records the time from construction to destruction under Stage. A null
+// Metrics records nothing.
+class StageTimer {
+private:
+    SolverMetrics* Metrics;
+    SolveStage Stage;
+    std::chrono::steady_clock::time_point Start;
+
+public:
+    StageTimer(SolverMetrics* Metrics, SolveStage Stage) : Metrics(Metrics), Stage(Stage), Start(std::chrono::steady_clock::now()) { }
+
+    ~StageTimer() {
+        if (Metrics) Metrics->Record(Stage, std::chrono::steady_clock::now() - Start);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <list>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "Matcher.h"
+#include "Pyramid.h"
+#include "Correlate.h"
+
+// Everything the matcher needs from a puzzle piece, built once per shape.
+struct PieceModel {
+    PieceTemplate Template;
+    // HalfSizeTemplate phases for FindPiecePyramid, indexed PhaseY * 2 + PhaseX.
+    std::array<PieceTemplate, 4> Halves;
+    // Zero-mean luma of the inner window for the correlation engine.
+    CorrelationPatch Patch;
+    // Row of the piece texture MakeSquare cut the square from, or -1.
+    int SquareY = -1;
+    // The piece texture itself, kept only while solves are recorded so one
+    // answered from a URL hit is still recorded with its piece.
+    std::vector<uint8_t> Source;
+
+    explicit PieceModel(PieceTemplate Full, CorrelationPatch Luma = {}) : Template(std::move(Full)), Patch(std::move(Luma)) {
+        for (int Phase = 0; Phase < 4; ++Phase) {
+            Halves[Phase] = HalfSizeTemplate(Template, Phase % 2, Phase / 2);
+        }
+    }
+
+    size_t Bytes() const {
+        size_t Total = sizeof(*this) + TemplateBytes(Template) + Patch.Values.size() * sizeof(float) + Source.size();
+        for (const PieceTemplate& Half : Halves) {
+            Total += TemplateBytes(Half);
+        }
+        return Total;
+    }
+
+private:
+    static size_t TemplateBytes(const PieceTemplate& Template) {
+        return Template.Pixels.size() * sizeof(uint32_t) + Template.Luma.size() * sizeof(uint8_t) +
+               Template.Samples.size() * sizeof(PieceTemplate::Sample);
+    }
+};
+
+struct PieceCacheStats {
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Evictions = 0;
+    size_t Entries = 0;
+    size_t Bytes = 0;
+    size_t MaxBytes = 0;
+};
+
+// LRU of piece models keyed by a hash of the downloaded piece bytes, with the
+// URLs each one was fetched from as secondary keys. Evicts least recently used
+// models once the total size passes MaxBytes. Safe to share between threads.
+class PieceCache {
+private:
+    struct Entry {
+        uint64_t Hash;
+        std::shared_ptr<const PieceModel> Model;
+        size_t Bytes;
+        std::vector<std::string> Urls;
+    };
+
+    mutable std::mutex Lock;
+    std::list<Entry> Order;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> ByHash;
+    std::unordered_map<std::string, uint64_t> ByUrl;
+    PieceCacheStats Counters;
+
+public:
+    explicit PieceCache(size_t MaxBytes = 4 << 20) {
+        Counters.MaxBytes = MaxBytes;
+    }
+
+    PieceCache(const PieceCache&) = delete;
+    PieceCache& operator=(const PieceCache&) = delete;
+
+    std::shared_ptr<const PieceModel> Find(uint64_t Hash) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Touch(ByHash.find(Hash));
+    }
+
+    std::shared_ptr<const PieceModel> FindUrl(const std::string& Url) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto Alias = ByUrl.find(Url);
+        return Touch(Alias == ByUrl.end() ? ByHash.end() : ByHash.find(Alias->second));
+    }
+
+    // Url may be empty. Re-inserting a known hash only adds the alias.
+    void Insert(uint64_t Hash, const std::string& Url, std::shared_ptr<const PieceModel> Model) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        auto It = ByHash.find(Hash);
+        if (It == ByHash.end()) {
+            size_t Bytes = Model->Bytes();
+            if (Bytes > Counters.MaxBytes) return;
+
+            Order.push_front({ Hash, std::move(Model), Bytes, {} });
+            It = ByHash.emplace(Hash, Order.begin()).first;
+            Counters.Bytes += Bytes;
+            while (Counters.Bytes > Counters.MaxBytes) {
+                Evict();
+            }
+        } else {
+            Order.splice(Order.begin(), Order, It->second);
+        }
+
+        if (!Url.empty()) {
+            // A URL that now serves different bytes moves to the new model.
+            auto [Alias, Added] = ByUrl.try_emplace(Url, Hash);
+            if (!Added && Alias->second != Hash) {
+                Unlink(Alias->second, Url);
+                Alias->second = Hash;
+                Added = true;
+            }
+            if (Added) It->second->Urls.push_back(Url);
+        }
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Order.clear();
+        ByHash.clear();
+        ByUrl.clear();
+        Counters.Bytes = 0;
+    }
+
+    PieceCacheStats Stats() const {
+        std::lock_guard<std::mutex> Guard(Lock);
+        PieceCacheStats Snapshot = Counters;
+        Snapshot.Entries = Order.size();
+        return Snapshot;
+    }
+
+private:
+    std::shared_ptr<const PieceModel> Touch(std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator It) {
+        if (It == ByHash.end()) {
+            ++Counters.Misses;
+            return nullptr;
+        }
+        ++Counters.Hits;
+        Order.splice(Order.begin(), Order, It->second);
+        return It->second->Model;
+    }
+
+    void Unlink(uint64_t Hash, const std::string& Url) {
+        auto It = ByHash.find(Hash);
+        if (It == ByHash.end()) return;
+        auto& Urls = It->second->Urls;
+        Urls.erase(std::remove(Urls.begin(), Urls.end(), Url), Urls.end());
+    }
+
+    void Evict() {
+        Entry& Oldest = Order.back();
+        for (const std::string& Url : Oldest.Urls) {
+            ByUrl.erase(Url);
+        }
+        Counters.Bytes -= Oldest.Bytes;
+        ++Counters.Evictions;
+        ByHash.erase(Oldest.Hash);
+        Order.pop_back();
+    }
+};
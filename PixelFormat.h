@@ -0,0 +1,126 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include "BitMap.h"
+#include "BitMapPool.h"
+#include "Simd.h"
+
+// Pixel format tags. RGB8 and RGBA8 name the two RTTEX file layouts; both
+// decode into the same 4-byte RGB_A layout a BitMap holds. Luma8 is a single
+// byte per pixel.
+struct RGB8 { };
+struct RGBA8 { };
+struct Luma8 { };
+
+// Decode maps one file pixel to BitMap byte order. The byte shuffles are the
+// ones the original struct copies produced, odd as they are: an RGB file's
+// bytes land in the g, b and a fields and r is always 0xFF.
+template <>
+struct PixelFormat<RGBA8> {
+    using Pixel = RGB_A;
+    static constexpr size_t FileBytes = 4;
+
+    static void Decode(const uint8_t* In, uint8_t* Out) {
+        Out[0] = In[1];
+        Out[1] = In[0];
+        Out[2] = In[3];
+        Out[3] = In[2];
+    }
+};
+
+template <>
+struct PixelFormat<RGB8> {
+    using Pixel = RGB_A;
+    static constexpr size_t FileBytes = 3;
+
+    static void Decode(const uint8_t* In, uint8_t* Out) {
+        Out[0] = In[0];
+        Out[1] = In[1];
+        Out[2] = In[2];
+        Out[3] = 0xFF;
+    }
+};
+
+template <>
+struct PixelFormat<Luma8> {
+    using Pixel = uint8_t;
+
+    // BT.601 weights in 8.8 fixed point over the fields the matcher compares.
+    static uint8_t FromRGBA(const RGB_A& Color) {
+        return static_cast<uint8_t>((Color.r * 77 + Color.g * 150 + Color.b * 29 + 128) >> 8);
+    }
+};
+
+inline void LumaRowScalar(const RGB_A* In, uint8_t* Out, int Width) {
+    for (int x = 0; x < Width; ++x) {
+        Out[x] = PixelFormat<Luma8>::FromRGBA(In[x]);
+    }
+}
+
+#ifdef SIMD_X86
+// Pixel bytes are g, b, a, r, so the low bytes of the 16-bit lanes hold g and
+// a and the high bytes b and r; one madd per pair applies the weights.
+inline void LumaRowSSE2(const RGB_A* In, uint8_t* Out, int Width) {
+    const __m128i LowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i WeightsGA = _mm_set1_epi32(150);
+    const __m128i WeightsBR = _mm_set1_epi32((77 << 16) | 29);
+    const __m128i Round = _mm_set1_epi32(128);
+    int x = 0;
+    for (; x + 8 <= Width; x += 8) {
+        __m128i Sum[2];
+        for (int Half = 0; Half < 2; ++Half) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(In + x + Half * 4));
+            __m128i GA = _mm_madd_epi16(_mm_and_si128(v, LowBytes), WeightsGA);
+            __m128i BR = _mm_madd_epi16(_mm_srli_epi16(v, 8), WeightsBR);
+            Sum[Half] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(GA, BR), Round), 8);
+        }
+        __m128i Words = _mm_packs_epi32(Sum[0], Sum[1]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(Out + x), _mm_packus_epi16(Words, Words));
+    }
+    LumaRowScalar(In + x, Out + x, Width - x);
+}
+#endif
+
+inline void LumaRow(const RGB_A* In, uint8_t* Out, int Width) {
+#ifdef SIMD_X86
+    LumaRowSSE2(In, Out, Width);
+#else
+    LumaRowScalar(In, Out, Width);
+#endif
+}
+
+// Calls Body with RGBA8{} or RGB8{}, so per-pixel code is compiled once per
+// format and the choice is made once per image.
+template <class Fn>
+decltype(auto) DispatchFormat(bool useAlpha, Fn&& Body) {
+    if (useAlpha) return Body(RGBA8{});
+    return Body(RGB8{});
+}
+
+// One byte per pixel, pooled like BitMap pixels.
+class LumaPlane {
+private:
+    PixelBuffer Bits;
+
+public:
+    int Height;
+    int Width;
+
+    LumaPlane(int h, int w) : Bits(BitMapPool::Get().Acquire(static_cast<size_t>(h) * w)), Height(h), Width(w) { }
+
+    explicit LumaPlane(BitMap& Source) : LumaPlane(Source.Height, Source.Width) {
+        for (int y = 0; y < Height; ++y) {
+            LumaRow(Source.Row<RGBA8>(y).data(), Row(y).data(), Width);
+        }
+    }
+
+    uint8_t* GetBitData() {
+        return Bits.data();
+    }
+
+    std::span<uint8_t> Row(int y) {
+        return { Bits.data() + static_cast<size_t>(y) * Width, static_cast<size_t>(Width) };
+    }
+};
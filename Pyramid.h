@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "BitMap.h"
+#include "Matcher.h"
+
+// 2x2 box filter, truncating per byte. Odd trailing rows and columns are dropped.
+inline std::unique_ptr<BitMap> HalfSize(BitMap& Source) {
+    auto Half = std::make_unique<BitMap>(Source.Height / 2, Source.Width / 2, BitMap::Uninitialized);
+    for (int y = 0; y < Half->Height; ++y) {
+        const uint8_t* Top = Source.GetBitData(0, y * 2);
+        const uint8_t* Bottom = Source.GetBitData(0, y * 2 + 1);
+        uint8_t* Out = Half->GetBitData(0, y);
+        for (int x = 0; x < Half->Width * 4; ++x) {
+            int i = (x & ~3) * 2 + (x & 3);
+            Out[x] = static_cast<uint8_t>((Top[i] + Top[i + 4] + Bottom[i] + Bottom[i + 4]) >> 2);
+        }
+    }
+    return Half;
+}
+
+// Half-resolution version of the full rows of a template, starting at
+// (PhaseX, PhaseY) so the blocks line up with the background's 2x2 grid for
+// origins of that parity. Four pixels within the tolerance of the background
+// still average to within it after truncation, so the coarse scan never drops
+// a real match.
+inline PieceTemplate HalfSizeTemplate(const PieceTemplate& Fine, int PhaseX, int PhaseY) {
+    int FullRows = Fine.Count / Fine.Width;
+    int Width = (Fine.Width - PhaseX) / 2;
+    int Rows = (FullRows - PhaseY) / 2;
+    if (Width <= 0 || Rows <= 0) return PieceTemplate();
+
+    std::vector<uint32_t> Window(static_cast<size_t>(Width) * Rows);
+    for (int y = 0; y < Rows; ++y) {
+        for (int x = 0; x < Width; ++x) {
+            int u = PhaseX + x * 2;
+            int v = PhaseY + y * 2;
+            const uint8_t* a = reinterpret_cast<const uint8_t*>(&Fine.Pixels[v * Fine.Width + u]);
+            const uint8_t* b = reinterpret_cast<const uint8_t*>(&Fine.Pixels[(v + 1) * Fine.Width + u]);
+            uint8_t* Out = reinterpret_cast<uint8_t*>(&Window[y * Width + x]);
+            for (int c = 0; c < 4; ++c) {
+                Out[c] = static_cast<uint8_t>((a[c] + a[c + 4] + b[c] + b[c + 4]) >> 2);
+            }
+        }
+    }
+    return PieceTemplate(Width, std::move(Window), Fine.Tolerance);
+}
+
+// True when Coarse has the size of a half-resolution level of Image.
+inline bool IsHalfOf(const BitMap& Coarse, const BitMap& Image) {
+    return Coarse.Width == Image.Width / 2 && Coarse.Height == Image.Height / 2;
+}
+
+// Coarse-to-fine version of FindPiece. Candidates come from a half-resolution
+// scan (one per origin parity) and are then checked at full resolution in
+// raster order. With the box-filtered Coarse level this gives the same answer
+// as a full scan; origins whose window wraps past the row end have no 2D
+// coarse counterpart and are scanned directly. A Coarse level from elsewhere
+// (the file's own mip) may filter differently, so a miss falls back to a full
+// scan in that case. Callers searching one image several times pass the
+// HalfSize level they built with CoarseBoxFiltered set; without a Coarse
+// level of the right size one is built for this call. Halves, when given,
+// are the four HalfSizeTemplate phases of Template indexed PhaseY * 2 + PhaseX.
+inline bool FindPiecePyramid(BitMap& Image, int XLimit, int YBegin, int YEnd, const PieceTemplate& Template, int& OutX, int& OutY,
+                             BitMap* Coarse = nullptr, const std::array<PieceTemplate, 4>* Halves = nullptr, bool CoarseBoxFiltered = false) {
+    if (!Template.Valid()) return false;
+
+    std::unique_ptr<BitMap> Built;
+    bool BoxFiltered = CoarseBoxFiltered;
+    if (!Coarse || !IsHalfOf(*Coarse, Image)) {
+        Built = HalfSize(Image);
+        Coarse = Built.get();
+        BoxFiltered = true;
+    }
+
+    PieceScanner Fine(Image, XLimit, Template);
+    int WrapStart = std::max(0, Image.Width - Template.Width + 1);
+
+    std::vector<std::pair<int, int>> Candidates;
+    for (int PhaseY = 0; PhaseY < 2; ++PhaseY) {
+        for (int PhaseX = 0; PhaseX < 2; ++PhaseX) {
+            PieceTemplate Built;
+            const PieceTemplate& Half = Halves ? (*Halves)[PhaseY * 2 + PhaseX] : (Built = HalfSizeTemplate(Template, PhaseX, PhaseY));
+            if (!Half.Valid()) return FindPiece(Image, XLimit, YBegin, YEnd, Template, OutX, OutY);
+
+            PieceScanner Scanner(*Coarse, Coarse->Width, Half);
+            int CoarseBegin = (std::max(0, YBegin) + PhaseY + 1) / 2;
+            int CoarseEnd = std::min(Coarse->Height, (YEnd + PhaseY + 1) / 2);
+            for (int cy = CoarseBegin; cy < CoarseEnd; ++cy) {
+                for (int cx = Scanner.Find(cy, 0); cx >= 0; cx = Scanner.Find(cy, cx + 1)) {
+                    int X = cx * 2 - PhaseX;
+                    int Y = cy * 2 - PhaseY;
+                    if (X >= 0 && X < std::min(XLimit, WrapStart) && Y >= YBegin && Y < YEnd) {
+                        Candidates.emplace_back(Y, X);
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(Candidates.begin(), Candidates.end());
+    size_t Next = 0;
+    for (int Y = YBegin; Y < YEnd; ++Y) {
+        for (; Next < Candidates.size() && Candidates[Next].first == Y; ++Next) {
+            if (Fine.Matches(Candidates[Next].second, Y)) {
+                OutX = Candidates[Next].second;
+                OutY = Y;
+                return true;
+            }
+        }
+
+        int X = Fine.Find(Y, WrapStart);
+        if (X >= 0) {
+            OutX = X;
+            OutY = Y;
+            return true;
+        }
+    }
+
+    return !BoxFiltered && FindPiece(Image, XLimit, YBegin, YEnd, Template, OutX, OutY);
+}
@@ -1,9 +1,18 @@
 #ifndef RTTEX_H_
 #define RTTEX_H_
 
-#include <fstream>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <vector>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
 #include "BitMap.h"
+#include "MappedFile.h"
+#include "PixelFormat.h"
+#include "RowDecode.h"
+#include "TextureReader.h"
 
 struct RTTEXINFO {
     int Height;
@@ -17,52 +26,213 @@ struct RTTEXINFO {
     int MipMapCount;
 };
 
+struct RTTEXMIPHEADER {
+    int Height;
+    int Width;
+    int DataSize;
+    int MipLevel;
+    int Reserved[2];
+};
+
 struct RTTEX {
 private:
+    // File rows still waiting to be decoded into bitMap, for lazy textures.
+    // Rows go in tiles of TileRows under Lock; Ready is checked first so
+    // decoded tiles cost one atomic load.
+    struct PendingRows {
+        std::span<const uint8_t> Pixels;
+        RowDecoder DecodeRow;
+        size_t RowBytes;
+        int TileRows;
+        std::unique_ptr<std::atomic<bool>[]> Ready;
+        std::mutex Lock;
+    };
+
+    // Declared first: the bitMap initializer fills them.
+    std::vector<std::unique_ptr<BitMap>> Mips;
+    std::unique_ptr<LumaPlane> Luma;
     std::unique_ptr<BitMap> bitMap;
+    std::unique_ptr<PendingRows> Pending;
 
 public:
+    // 8 byte magic, RTTEXINFO, 64 reserved bytes and the first mip header.
+    static constexpr size_t HeaderSize = 8 + sizeof(RTTEXINFO) + 88;
+
+    struct LazyTag { };
+    static constexpr LazyTag Lazy{};
+
     RTTEXINFO Info;
 
-    RTTEX(const char* File) {
-        std::ifstream stream(File, std::ios_base::in | std::ios::binary);
-        if (!stream) {
-            throw std::runtime_error("Failed to open file");
+    // KeepMips also decodes the smaller mip levels stored after the main image.
+    // MakeLuma fills a luma plane of the main image in the same pass, each row
+    // right after it is decoded.
+    explicit RTTEX(std::span<const uint8_t> Data, bool KeepMips = false, bool MakeLuma = false)
+        : bitMap(Decode(Data, Info, KeepMips ? &Mips : nullptr, MakeLuma ? &Luma : nullptr)) { }
+
+    RTTEX(const char* File, bool KeepMips = false, bool MakeLuma = false) : RTTEX(MappedFile(File).GetData(), KeepMips, MakeLuma) { }
+
+    // Reads only the header; rows are decoded a tile at a time the first time
+    // GetRows covers them. Data must outlive the texture. RTPACK payloads are
+    // decoded up front instead: rows are stored bottom-up, so the top row every
+    // search starts from is the last one out of the stream.
+    RTTEX(std::span<const uint8_t> Data, LazyTag, int TileRows = 16) {
+        if (IsRTPACK(Data)) {
+            bitMap = Decode(Data, Info);
+            return;
+        }
+
+        Pending = std::make_unique<PendingRows>();
+        PendingRows& Rows = *Pending;
+        RawReader Reader(Data);
+        ReadHeader(Reader, Info);
+        Rows.Pixels = Data.subspan(HeaderSize);
+
+        Rows.RowBytes = static_cast<size_t>(Info.Width) * (Info.useAlpha ? 4 : 3);
+        if (Rows.Pixels.size() < Rows.RowBytes * Info.Height) {
+            throw std::runtime_error("Truncated RTTEX pixel data");
+        }
+
+        Rows.DecodeRow = GetRowDecoder(Info.useAlpha);
+        Rows.TileRows = std::max(1, TileRows);
+        int Tiles = (Info.Height + Rows.TileRows - 1) / Rows.TileRows;
+        Rows.Ready = std::make_unique<std::atomic<bool>[]>(Tiles);
+        bitMap = std::make_unique<BitMap>(Info.Height, Info.Width, BitMap::Uninitialized);
+    }
+
+    // An undecoded image of Header's size, for decoders that fill its rows
+    // themselves.
+    explicit RTTEX(const RTTEXINFO& Header)
+        : bitMap(std::make_unique<BitMap>(Header.Height, Header.Width, BitMap::Uninitialized)), Info(Header) { }
+
+    static std::unique_ptr<BitMap> Decode(std::span<const uint8_t> Data, RTTEXINFO& Info, std::vector<std::unique_ptr<BitMap>>* Mips = nullptr,
+                                          std::unique_ptr<LumaPlane>* Luma = nullptr) {
+        if (IsRTPACK(Data)) {
+            InflateReader Reader(Data);
+            return Decode(Reader, Info, Mips, Luma);
+        }
+        RawReader Reader(Data);
+        return Decode(Reader, Info, Mips, Luma);
+    }
+
+    template <class Reader>
+    static std::unique_ptr<BitMap> Decode(Reader& Source, RTTEXINFO& Info, std::vector<std::unique_ptr<BitMap>>* Mips = nullptr,
+                                          std::unique_ptr<LumaPlane>* Luma = nullptr) {
+        ReadHeader(Source, Info);
+        return DispatchFormat(Info.useAlpha, [&](auto Fmt) { return DecodeLevels<decltype(Fmt)>(Source, Info, Mips, Luma); });
+    }
+
+    template <class Reader>
+    static void ReadHeader(Reader& Source, RTTEXINFO& Info) {
+        if (Source.Remaining() < HeaderSize) {
+            throw std::runtime_error("Truncated RTTEX header");
+        }
+
+        const uint8_t* Header = Source.Next(HeaderSize);
+        if (std::memcmp(Header, "RTTXTR", 6) != 0) {
+            throw std::runtime_error("Unknown texture container");
+        }
+
+        std::memcpy(&Info, Header + 8, sizeof(Info));
+        // The searches walk RealHeight rows of RealWidth pixels, and textures
+        // also come from other processes, so the unpadded size must fit.
+        if (Info.Height <= 0 || Info.Width <= 0 || Info.RealHeight <= 0 || Info.RealWidth <= 0 || Info.RealHeight > Info.Height ||
+            Info.RealWidth > Info.Width) {
+            throw std::runtime_error("Invalid RTTEX dimensions");
+        }
+    }
+
+    // Main image and mips with the pixel format fixed at compile time.
+    template <class Fmt, class Reader>
+    static std::unique_ptr<BitMap> DecodeLevels(Reader& Source, const RTTEXINFO& Info, std::vector<std::unique_ptr<BitMap>>* Mips,
+                                                std::unique_ptr<LumaPlane>* Luma) {
+        constexpr size_t PixelSize = PixelFormat<Fmt>::FileBytes;
+        size_t RowBytes = static_cast<size_t>(Info.Width) * PixelSize;
+        if (Source.Remaining() < RowBytes * Info.Height) {
+            throw std::runtime_error("Truncated RTTEX pixel data");
         }
 
-        stream.seekg(8, std::ios_base::beg);
-        stream.read(reinterpret_cast<char*>(&Info), sizeof(Info));
-        bitMap = std::make_unique<BitMap>(Info.Height, Info.Width);
-
-        stream.seekg(88, std::ios_base::cur);
-        uint8_t* Bits = reinterpret_cast<uint8_t*>(bitMap->GetBitData());
-
-        for (int y = Info.Height - 1; y >= 0; --y) {
-            for (int x = 0; x < Info.Width; ++x) {
-                if (Info.useAlpha) {
-                    RGB_A rgba;
-                    stream.read(reinterpret_cast<char*>(&rgba), sizeof(rgba));
-                    int index = (x + y * Info.Width) * sizeof(int);
-                    Bits[index + 0] = rgba.b;
-                    Bits[index + 1] = rgba.g;
-                    Bits[index + 2] = rgba.r;
-                    Bits[index + 3] = rgba.a;
-                } else {
-                    ColorRGB rgb;
-                    stream.read(reinterpret_cast<char*>(&rgb), sizeof(rgb));
-                    int index = (x + y * Info.Width) * sizeof(int);
-                    Bits[index + 0] = rgb.b;
-                    Bits[index + 1] = rgb.g;
-                    Bits[index + 2] = rgb.r;
-                    Bits[index + 3] = 0xFF; // Alpha channel to 255 (opaque)
-                }
+        RowDecoder DecodeRow = GetRowDecoder<Fmt>();
+        if (Luma) *Luma = std::make_unique<LumaPlane>(Info.Height, Info.Width);
+        auto bitMap = DecodeLevel(Source, DecodeRow, Info.Height, Info.Width, RowBytes, Luma ? Luma->get() : nullptr);
+
+        // Each further level has its own mip header. A level that doesn't fit
+        // ends the chain; the main image is all the solver needs.
+        for (int Level = 1; Mips && Level < Info.MipMapCount; ++Level) {
+            if (Source.Remaining() < sizeof(RTTEXMIPHEADER)) break;
+
+            RTTEXMIPHEADER Mip;
+            std::memcpy(&Mip, Source.Next(sizeof(Mip)), sizeof(Mip));
+            size_t MipRowBytes = static_cast<size_t>(Mip.Width) * PixelSize;
+            if (Mip.Height <= 0 || Mip.Width <= 0 || static_cast<size_t>(Mip.DataSize) < MipRowBytes * Mip.Height ||
+                Source.Remaining() < static_cast<size_t>(Mip.DataSize)) break;
+
+            Mips->push_back(DecodeLevel(Source, DecodeRow, Mip.Height, Mip.Width, MipRowBytes));
+            if (size_t Padding = Mip.DataSize - MipRowBytes * Mip.Height) {
+                Source.Next(Padding);
             }
         }
+
+        return bitMap;
+    }
+
+    template <class Reader>
+    static std::unique_ptr<BitMap> DecodeLevel(Reader& Source, RowDecoder DecodeRow, int Height, int Width, size_t RowBytes,
+                                               LumaPlane* Luma = nullptr) {
+        auto Level = std::make_unique<BitMap>(Height, Width, BitMap::Uninitialized);
+
+        // Rows are stored bottom-up.
+        for (int y = Height - 1; y >= 0; --y) {
+            DecodeRow(Source.Next(RowBytes), Level->GetBitData(0, y), Width);
+            if (Luma) LumaRow(Level->Row<RGBA8>(y).data(), Luma->Row(y).data(), Width);
+        }
+        return Level;
     }
 
     BitMap* GetMap() {
+        return GetRows(0, Info.Height);
+    }
+
+    // True when built with Lazy from an uncompressed file, whether or not every
+    // row has been decoded since.
+    bool IsLazy() const {
+        return Pending != nullptr;
+    }
+
+    // The main image with at least rows [YBegin, YEnd) decoded. Safe to call
+    // from several threads at once.
+    BitMap* GetRows(int YBegin, int YEnd) {
+        if (!Pending) return bitMap.get();
+
+        PendingRows& Rows = *Pending;
+        YBegin = std::max(0, YBegin);
+        YEnd = std::min(Info.Height, YEnd);
+        for (int Tile = YBegin / Rows.TileRows; YBegin < YEnd && Tile <= (YEnd - 1) / Rows.TileRows; ++Tile) {
+            if (Rows.Ready[Tile].load(std::memory_order_acquire)) continue;
+
+            std::lock_guard<std::mutex> Guard(Rows.Lock);
+            if (Rows.Ready[Tile].load(std::memory_order_relaxed)) continue;
+
+            int First = Tile * Rows.TileRows;
+            int Last = std::min(Info.Height, First + Rows.TileRows);
+            for (int y = First; y < Last; ++y) {
+                size_t Offset = static_cast<size_t>(Info.Height - 1 - y) * Rows.RowBytes;
+                Rows.DecodeRow(Rows.Pixels.data() + Offset, bitMap->GetBitData(0, y), Info.Width);
+            }
+            Rows.Ready[Tile].store(true, std::memory_order_release);
+        }
         return bitMap.get();
     }
+
+    // Null unless the texture was decoded with MakeLuma.
+    LumaPlane* GetLuma() {
+        return Luma.get();
+    }
+
+    // Level 0 is the main image; null when the level wasn't decoded.
+    BitMap* GetMip(int Level) {
+        if (Level == 0) return GetMap();
+        return Level - 1 < static_cast<int>(Mips.size()) ? Mips[Level - 1].get() : nullptr;
+    }
 };
 
 #endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "BitMap.h"
+#include "PixelFormat.h"
+#include "Simd.h"
+
+// Converts one RTTEX file row into BitMap byte order. The scalar versions are
+// the reference: they reproduce the original per-pixel struct copies exactly.
+using RowDecoder = void (*)(const uint8_t* Source, uint8_t* Dest, int Width);
+
+template <class Fmt>
+inline void DecodeRowScalar(const uint8_t* Source, uint8_t* Dest, int Width) {
+    for (int x = 0; x < Width; ++x) {
+        PixelFormat<Fmt>::Decode(Source + x * PixelFormat<Fmt>::FileBytes, Dest + x * 4);
+    }
+}
+
+inline void DecodeRowRGBAScalar(const uint8_t* Source, uint8_t* Dest, int Width) {
+    DecodeRowScalar<RGBA8>(Source, Dest, Width);
+}
+
+inline void DecodeRowRGBScalar(const uint8_t* Source, uint8_t* Dest, int Width) {
+    DecodeRowScalar<RGB8>(Source, Dest, Width);
+}
+
+#ifdef SIMD_X86
+// RGBA rows only swap the bytes inside each 16-bit half, which SSE2 does with shifts.
+inline void DecodeRowRGBASSE2(const uint8_t* Source, uint8_t* Dest, int Width) {
+    int x = 0;
+    for (; x + 4 <= Width; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + x * 4));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Dest + x * 4), v);
+    }
+    DecodeRowRGBAScalar(Source + x * 4, Dest + x * 4, Width - x);
+}
+
+SIMD_TARGET("avx2")
+inline void DecodeRowRGBAAVX2(const uint8_t* Source, uint8_t* Dest, int Width) {
+    int x = 0;
+    for (; x + 8 <= Width; x += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Source + x * 4));
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(Dest + x * 4), v);
+    }
+    DecodeRowRGBASSE2(Source + x * 4, Dest + x * 4, Width - x);
+}
+
+// RGB rows expand 12 source bytes to 4 pixels. Each load reads 16 bytes, so the
+// vector loops stop early enough to never touch memory past the end of the row.
+SIMD_TARGET("ssse3")
+inline void DecodeRowRGBSSSE3(const uint8_t* Source, uint8_t* Dest, int Width) {
+    const __m128i Shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i Alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    int x = 0;
+    for (; x + 6 <= Width; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + x * 3));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, Shuffle), Alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(Dest + x * 4), v);
+    }
+    DecodeRowRGBScalar(Source + x * 3, Dest + x * 4, Width - x);
+}
+
+SIMD_TARGET("avx2")
+inline void DecodeRowRGBAVX2(const uint8_t* Source, uint8_t* Dest, int Width) {
+    const __m256i Shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i Alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    int x = 0;
+    for (; x + 10 <= Width; x += 8) {
+        __m128i Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + x * 3));
+        __m128i High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Source + x * 3 + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(Low), High, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, Shuffle), Alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(Dest + x * 4), v);
+    }
+    DecodeRowRGBSSSE3(Source + x * 3, Dest + x * 4, Width - x);
+}
+#endif
+
+// Best row decoder for Fmt on this CPU.
+template <class Fmt>
+inline RowDecoder GetRowDecoder() {
+#ifdef SIMD_X86
+    const CpuFeatures& Cpu = CpuFeatures::Get();
+    if constexpr (std::is_same_v<Fmt, RGBA8>) {
+        return Cpu.AVX2 ? DecodeRowRGBAAVX2 : DecodeRowRGBASSE2;
+    } else {
+        if (Cpu.AVX2) return DecodeRowRGBAVX2;
+        if (Cpu.SSSE3) return DecodeRowRGBSSSE3;
+    }
+#endif
+    return DecodeRowScalar<Fmt>;
+}
+
+inline RowDecoder GetRowDecoder(bool useAlpha) {
+    return DispatchFormat(useAlpha, [](auto Fmt) { return GetRowDecoder<decltype(Fmt)>(); });
+}
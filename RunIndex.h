@@ -0,0 +1,148 @@
+#pragma once
+
+#include <bit>
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "BitMap.h"
+#include "Simd.h"
+
+struct PixelRun {
+    int Start;
+    int Length;
+
+    int End() const {
+        return Start + Length;
+    }
+};
+
+// Sets bit x of Bits for every pixel of Row equal to Color. Bits must hold
+// (Width + 63) / 64 zeroed words.
+using RowMaskFn = void (*)(const uint32_t* Row, int Width, uint32_t Color, uint64_t* Bits);
+
+inline void RowMaskScalar(const uint32_t* Row, int Width, uint32_t Color, uint64_t* Bits) {
+    for (int x = 0; x < Width; ++x) {
+        uint32_t Pixel;
+        std::memcpy(&Pixel, Row + x, sizeof(Pixel));
+        if (Pixel == Color) {
+            Bits[x >> 6] |= uint64_t(1) << (x & 63);
+        }
+    }
+}
+
+#ifdef SIMD_X86
+inline void RowMaskSSE2(const uint32_t* Row, int Width, uint32_t Color, uint64_t* Bits) {
+    const __m128i Target = _mm_set1_epi32(static_cast<int>(Color));
+    int x = 0;
+    for (; x + 4 <= Width; x += 4) {
+        __m128i v = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Row + x)), Target);
+        Bits[x >> 6] |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(v))) << (x & 63);
+    }
+    for (; x < Width; ++x) {
+        if (Row[x] == Color) Bits[x >> 6] |= uint64_t(1) << (x & 63);
+    }
+}
+
+SIMD_TARGET("avx2")
+inline void RowMaskAVX2(const uint32_t* Row, int Width, uint32_t Color, uint64_t* Bits) {
+    const __m256i Target = _mm256_set1_epi32(static_cast<int>(Color));
+    int x = 0;
+    for (; x + 8 <= Width; x += 8) {
+        __m256i v = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(Row + x)), Target);
+        Bits[x >> 6] |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(v))) << (x & 63);
+    }
+    for (; x < Width; ++x) {
+        if (Row[x] == Color) Bits[x >> 6] |= uint64_t(1) << (x & 63);
+    }
+}
+#endif
+
+inline RowMaskFn GetRowMaskKernel() {
+#ifdef SIMD_X86
+    return CpuFeatures::Get().AVX2 ? RowMaskAVX2 : RowMaskSSE2;
+#else
+    return RowMaskScalar;
+#endif
+}
+
+// Runs of one exact pixel value, per row, built in a single pass. Runs in a
+// row are sorted and never touch each other. Rows [FirstRow, Rows) are
+// indexed, and are addressed by their row in Map.
+class RunIndex {
+private:
+    std::vector<PixelRun> Runs;
+    std::vector<int> RowStart{ 0 };
+    std::vector<int> RowTotal;
+    std::vector<uint64_t> Bits;
+    int FirstRow = 0;
+
+public:
+    RunIndex() = default;
+
+    RunIndex(BitMap& Map, uint32_t Color, int Rows, int FirstRow = 0) {
+        Build(Map, Color, Rows, FirstRow);
+    }
+
+    // Indexes rows [FirstRow, Rows) of Map, replacing what was indexed before
+    // but keeping the buffers, so one index can be rebuilt row after row.
+    void Build(BitMap& Map, uint32_t Color, int Rows, int FirstRow = 0) {
+        this->FirstRow = FirstRow;
+        Runs.clear();
+        RowStart.assign(1, 0);
+        RowTotal.assign(std::max(0, Rows - FirstRow), 0);
+        Bits.resize((Map.Width + 63) / 64);
+        RowMaskFn Mask = GetRowMaskKernel();
+
+        for (int y = FirstRow; y < Rows; ++y) {
+            std::fill(Bits.begin(), Bits.end(), 0);
+            Mask(reinterpret_cast<const uint32_t*>(Map.GetBitData(0, y)), Map.Width, Color, Bits.data());
+
+            // Walk set/clear boundaries with bit scans rather than pixel by pixel.
+            int x = 0;
+            while (x < Map.Width) {
+                int Start = NextBit(Bits, x, true, Map.Width);
+                if (Start >= Map.Width) break;
+                int End = NextBit(Bits, Start, false, Map.Width);
+                Runs.push_back({ Start, End - Start });
+                RowTotal[y - FirstRow] += End - Start;
+                x = End;
+            }
+            RowStart.push_back(static_cast<int>(Runs.size()));
+        }
+    }
+
+    int Rows() const {
+        return FirstRow + static_cast<int>(RowTotal.size());
+    }
+
+    std::span<const PixelRun> Row(int y) const {
+        return { Runs.data() + RowStart[y - FirstRow], Runs.data() + RowStart[y - FirstRow + 1] };
+    }
+
+    // Matching pixels in row y.
+    int Total(int y) const {
+        return RowTotal[y - FirstRow];
+    }
+
+    // Matching pixels of row y inside [Begin, End).
+    int Count(int y, int Begin, int End) const {
+        int Matching = 0;
+        for (const PixelRun& Run : Row(y)) {
+            if (Run.Start >= End) break;
+            Matching += std::max(0, std::min(End, Run.End()) - std::max(Begin, Run.Start));
+        }
+        return Matching;
+    }
+
+private:
+    static int NextBit(const std::vector<uint64_t>& Bits, int From, bool Set, int Limit) {
+        for (int Word = From >> 6; Word < static_cast<int>(Bits.size()); ++Word) {
+            uint64_t w = Set ? Bits[Word] : ~Bits[Word];
+            if (Word == From >> 6) w &= ~uint64_t(0) << (From & 63);
+            if (w) return std::min(Limit, Word * 64 + std::countr_zero(w));
+        }
+        return Limit;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC emits any intrinsic without per-function flags, GCC and Clang need the
+// target attribute on kernels that use instructions above the build baseline.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET(x)
+#else
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#endif
+
+struct CpuFeatures {
+    bool SSSE3 = false;
+    bool SSE41 = false;
+    bool AVX2 = false;
+
+    static const CpuFeatures& Get() {
+        static const CpuFeatures Features = Detect();
+        return Features;
+    }
+
+private:
+    static CpuFeatures Detect() {
+        CpuFeatures Features;
+#ifdef SIMD_X86
+        uint32_t Regs[4] = {};
+        CpuId(1, 0, Regs);
+        Features.SSSE3 = (Regs[2] >> 9) & 1;
+        Features.SSE41 = (Regs[2] >> 19) & 1;
+
+        bool OSXSave = (Regs[2] >> 27) & 1;
+        bool AVX = (Regs[2] >> 28) & 1;
+        if (OSXSave && AVX && (GetXCR0() & 6) == 6) {
+            CpuId(7, 0, Regs);
+            Features.AVX2 = (Regs[1] >> 5) & 1;
+        }
+#endif
+        return Features;
+    }
+
+#ifdef SIMD_X86
+    static void CpuId(uint32_t Leaf, uint32_t SubLeaf, uint32_t* Regs) {
+#if defined(_MSC_VER)
+        int Info[4];
+        __cpuidex(Info, static_cast<int>(Leaf), static_cast<int>(SubLeaf));
+        for (int i = 0; i < 4; ++i) Regs[i] = static_cast<uint32_t>(Info[i]);
+#else
+        __cpuid_count(Leaf, SubLeaf, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+    }
+
+    static uint64_t GetXCR0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t Low, High;
+        __asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+        return (static_cast<uint64_t>(High) << 32) | Low;
+#endif
+    }
+#endif
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+using SocketHandle = SOCKET;
+constexpr SocketHandle InvalidSocket = INVALID_SOCKET;
+
+inline void CloseSocket(SocketHandle Socket) {
+    closesocket(Socket);
+}
+
+inline void ShutdownSocket(SocketHandle Socket) {
+    shutdown(Socket, SD_BOTH);
+}
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using SocketHandle = int;
+constexpr SocketHandle InvalidSocket = -1;
+
+inline void CloseSocket(SocketHandle Socket) {
+    close(Socket);
+}
+
+inline void ShutdownSocket(SocketHandle Socket) {
+    shutdown(Socket, SHUT_RDWR);
+}
+#endif
+
+// WSAStartup once per process; a no-op elsewhere.
+inline bool InitSockets() {
+#ifdef _WIN32
+    static const bool Ready = [] {
+        WSADATA Data;
+        return WSAStartup(MAKEWORD(2, 2), &Data) == 0;
+    }();
+    return Ready;
+#else
+    return true;
+#endif
+}
+
+// A peer that has gone fails the send instead of raising SIGPIPE.
+#ifdef MSG_NOSIGNAL
+constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+constexpr int SendFlags = 0;
+#endif
+
+inline bool SendAll(SocketHandle Socket, const void* Data, size_t Size) {
+    const char* Bytes = static_cast<const char*>(Data);
+    while (Size > 0) {
+        int Sent = send(Socket, Bytes, static_cast<int>(Size), SendFlags);
+        if (Sent <= 0) return false;
+        Bytes += Sent;
+        Size -= Sent;
+    }
+    return true;
+}
+
+inline bool RecvAll(SocketHandle Socket, void* Data, size_t Size) {
+    char* Bytes = static_cast<char*>(Data);
+    while (Size > 0) {
+        int Received = recv(Socket, Bytes, static_cast<int>(Size), 0);
+        if (Received <= 0) return false;
+        Bytes += Received;
+        Size -= Received;
+    }
+    return true;
+}
+
+// Filesystem address for a Unix domain socket; false when Path doesn't fit.
+inline bool UnixAddress(const std::string& Path, sockaddr_un& Address) {
+    Address = {};
+    Address.sun_family = AF_UNIX;
+    if (Path.empty() || Path.size() >= sizeof(Address.sun_path)) return false;
+    std::memcpy(Address.sun_path, Path.data(), Path.size());
+    return true;
+}
+
+// Identifies the file a socket was bound to, so a listener only ever removes
+// its own socket file and not one a later listener put at the same path.
+struct UnixSocketFile {
+    uint64_t Device = 0;
+    uint64_t Index = 0;
+
+    bool operator==(const UnixSocketFile&) const = default;
+};
+
+// False when nothing is at Path. IsSocket tells a socket file from any other.
+inline bool StatUnixSocket(const std::string& Path, UnixSocketFile& File, bool& IsSocket) {
+#ifdef _WIN32
+    DWORD Attributes = GetFileAttributesA(Path.c_str());
+    if (Attributes == INVALID_FILE_ATTRIBUTES) return false;
+    // Unix domain sockets are reparse points on Windows.
+    IsSocket = (Attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+
+    HANDLE Handle = CreateFileA(Path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    BY_HANDLE_FILE_INFORMATION Info;
+    bool Known = Handle != INVALID_HANDLE_VALUE && GetFileInformationByHandle(Handle, &Info);
+    if (Handle != INVALID_HANDLE_VALUE) CloseHandle(Handle);
+    File = Known ? UnixSocketFile{ Info.dwVolumeSerialNumber, (static_cast<uint64_t>(Info.nFileIndexHigh) << 32) | Info.nFileIndexLow }
+                 : UnixSocketFile{};
+    return true;
+#else
+    struct stat st;
+    if (lstat(Path.c_str(), &st) != 0) return false;
+    IsSocket = S_ISSOCK(st.st_mode);
+    File = { static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino) };
+    return true;
+#endif
+}
+
+// Removes the socket at Path if no one is listening on it any more, which is
+// what a process that didn't clean up leaves behind. False when Path is in
+// use: a live listener, or a file that isn't a socket.
+inline bool RemoveStaleSocket(const std::string& Path, const sockaddr_un& Address) {
+    UnixSocketFile File;
+    bool IsSocket;
+    if (!StatUnixSocket(Path, File, IsSocket)) return true;
+    if (!IsSocket) return false;
+
+    SocketHandle Probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Probe == InvalidSocket) return false;
+    bool Refused = connect(Probe, reinterpret_cast<const sockaddr*>(&Address), sizeof(Address)) != 0 &&
+#ifdef _WIN32
+                   WSAGetLastError() == WSAECONNREFUSED;
+#else
+                   errno == ECONNREFUSED;
+#endif
+    CloseSocket(Probe);
+    return Refused && std::remove(Path.c_str()) == 0;
+}
+
+// Listens on a Unix domain socket at Path, replacing a stale socket file left
+// by a process that didn't clean up but never one another listener is using.
+// Bound, when given, receives the socket file for RemoveUnixSocket.
+inline SocketHandle ListenUnix(const std::string& Path, UnixSocketFile* Bound = nullptr) {
+    sockaddr_un Address;
+    if (!InitSockets() || !UnixAddress(Path, Address) || !RemoveStaleSocket(Path, Address)) return InvalidSocket;
+
+    SocketHandle Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Listener == InvalidSocket) return InvalidSocket;
+    if (bind(Listener, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0 || listen(Listener, SOMAXCONN) != 0) {
+        CloseSocket(Listener);
+        return InvalidSocket;
+    }
+
+    bool IsSocket;
+    if (Bound && !StatUnixSocket(Path, *Bound, IsSocket)) *Bound = {};
+    return Listener;
+}
+
+// Removes the socket file at Path if it is still Bound.
+inline void RemoveUnixSocket(const std::string& Path, const UnixSocketFile& Bound) {
+    UnixSocketFile File;
+    bool IsSocket;
+    if (StatUnixSocket(Path, File, IsSocket) && IsSocket && File == Bound) {
+        std::remove(Path.c_str());
+    }
+}
+
+inline SocketHandle ConnectUnix(const std::string& Path) {
+    sockaddr_un Address;
+    if (!InitSockets() || !UnixAddress(Path, Address)) return InvalidSocket;
+
+    SocketHandle Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Socket == InvalidSocket) return InvalidSocket;
+    if (connect(Socket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0) {
+        CloseSocket(Socket);
+        return InvalidSocket;
+    }
+    return Socket;
+}
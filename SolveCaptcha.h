@@ -1,11 +1,24 @@
+#pragma once
+
 #include "RTTEX.h"
+#include "Matcher.h"
+#include "ThreadPool.h"
+#include "Pyramid.h"
+#include "Correlate.h"
+#include "RunIndex.h"
+#include "Fetcher.h"
+#include "PieceCache.h"
+#include "Hash.h"
+#include "Metrics.h"
+#include "CorpusPack.h"
+#include "AnswerCache.h"
+#include "StreamDecode.h"
 #include "variant2.hpp"
 #include "rtparam.hpp"
-#include <urlmon.h>
+#include <array>
 #include <vector>
 #include <chrono>
-
-#pragma comment(lib, "Urlmon.lib")
+#include <cstdarg>
 
 using namespace std::chrono;
 
@@ -14,148 +27,783 @@ struct Vector2 {
     Vector2(int x, int y) : x(static_cast<float>(x)), y(static_cast<float>(y)) {}
 };
 
-float GetAnswer(RTTEX& Image) {
-    const RGB_A WhiteColor(255, 255, 255, 255);
+// How AnswerByEquation places the piece. Exact needs the first window pixels
+// within the tolerance; Correlation takes the normalized cross-correlation
+// peak, which survives noise and brightness shifts at a fixed cost per
+// background; ExactThenCorrelation only correlates when the exact scan misses.
+enum class MatchEngine {
+    Exact,
+    Correlation,
+    ExactThenCorrelation
+};
+
+struct SolverOptions {
+    // Helpers for the GetAnswer and AnswerByEquation scans. Null keeps the
+    // whole search on the calling thread.
+    std::shared_ptr<WorkerPool> SearchPool;
+    int SearchTileRows = 16;
+
+    // Find piece candidates at half resolution first and only verify those at
+    // full resolution. UseFileMips takes the half level from the texture's own
+    // mip chain when it has one instead of box-filtering the background.
+    bool CoarseToFine = false;
+    bool UseFileMips = false;
+
+    // Build a luma plane while decoding the background and screen piece
+    // positions on it before comparing full pixels. Same answers, a quarter
+    // of the bytes on the first pass.
+    bool LumaPrefilter = false;
+
+    // Decode background rows the first time a search reaches them, so a solve
+    // that stops early never decodes the rest. Needs the whole image up front
+    // with CoarseToFine or LumaPrefilter, so it is ignored with either, and
+    // RTPACK backgrounds are always decoded whole.
+    bool LazyDecode = false;
+
+    // Correlation peaks scoring below MinCorrelation count as no match.
+    MatchEngine Engine = MatchEngine::Exact;
+    float MinCorrelation = 0.8f;
+
+    // The piece texture draws the piece at the height of its hole, so search
+    // the rows within BandMargin of where the square came from first and only
+    // scan the rest of the background when that band has no match.
+    bool GeometryBand = false;
+    int BandMargin = 16;
+
+    // Where textures come from. Null uses a shared WinHttpFetcher; tests can
+    // set an HttpFetcher and "http://" to fetch from a LoopbackServer.
+    std::shared_ptr<Fetcher> Http;
+    std::string Scheme = "https://";
+
+    // Ready-to-match templates of pieces seen before, keyed by the piece's
+    // bytes. With KeyPiecesByUrl a known piece URL skips the download too; a
+    // Recorder then makes models keep the piece bytes to record.
+    std::shared_ptr<PieceCache> Pieces = std::make_shared<PieceCache>();
+    bool KeyPiecesByUrl = false;
+
+    // Console progress lines. Turning them off keeps solver threads off the
+    // stdio lock when many bots solve at once.
+    bool Verbose = true;
+
+    // Per-stage latencies and outcome counts, read with SolverMetrics::Get().Snapshot().
+    bool CollectMetrics = true;
+
+    // Appends the textures, dialog fields and answer of every solve that
+    // didn't fail to a corpus pack for offline replay, zero answers included
+    // so misses can be replayed too. Solves answered before the background
+    // finished downloading have no texture to record and are skipped.
+    std::shared_ptr<CorpusRecorder> Recorder;
+
+    // Answers shared between processes, keyed by the background's bytes and
+    // checked before decoding. Cached answers scoring below MinCachedConfidence
+    // are solved again.
+    std::shared_ptr<AnswerCache> Answers;
+    float MinCachedConfidence = 0.9f;
+
+    // Decode the background as it downloads and scan each band of rows once it
+    // and every row below it are in, so the work overlaps the transfer. The
+    // piece is searched the same way once it arrives, except with CoarseToFine,
+    // LumaPrefilter or the Correlation engine, which need the whole image.
+    // Takes precedence over LazyDecode. StreamEarlyExit replies from the first
+    // band with a white bar and cancels the rest of the download, which only
+    // changes the answer when the background has more than one bar. A piece
+    // match can't end the download early, since a bar above it would win.
+    bool StreamDecode = false;
+    bool StreamEarlyExit = false;
+};
+
+inline SolverOptions CaptchaOptions;
+
+inline void CaptchaLog(const char* Format, ...) {
+    if (!CaptchaOptions.Verbose) return;
+
+    char Line[512];
+    va_list Args;
+    va_start(Args, Format);
+    vsnprintf(Line, sizeof(Line), Format, Args);
+    va_end(Args);
+    printf("[CAPTCHA]: %s", Line);
+}
+
+// Null when metrics are off, which StageTimer takes as "don't record".
+inline SolverMetrics* CaptchaMetrics() {
+    return CaptchaOptions.CollectMetrics ? &SolverMetrics::Get() : nullptr;
+}
+
+inline void CountOutcome(SolveCounter Counter) {
+    if (SolverMetrics* Metrics = CaptchaMetrics()) Metrics->Count(Counter);
+}
+
+// First X in row Y that is white with more than 50 white pixels in the 60
+// pixels starting at it.
+inline int FindWhiteBar(const RunIndex& Whites, int Y, int RealWidth, int Width) {
     const int threshold = 50;
+    const int window = 60;
 
-    for (int Y = 0; Y < Image.Info.RealHeight; ++Y) {
-        for (int X = 0; X < Image.Info.RealWidth; ++X) {
-            if (Image.GetMap()->GetPixelRGBA(X, Y) == WhiteColor) {
-                int WhitePixelCount = 1;
-                for (int i = 1; i < 60 && X + i < Image.Info.Width; ++i) {
-                    if (Image.GetMap()->GetPixelRGBA(X + i, Y) == WhiteColor) {
-                        if (++WhitePixelCount > threshold) {
-                            return static_cast<float>(X) / Image.Info.Width;
-                        }
-                    }
-                }
+    if (Whites.Total(Y) <= threshold) return -1;
+
+    auto Runs = Whites.Row(Y);
+    for (size_t r = 0; r < Runs.size() && Runs[r].Start < RealWidth; ++r) {
+        int RunEnd = std::min(Runs[r].End(), RealWidth);
+        for (int X = Runs[r].Start; X < RunEnd; ++X) {
+            int WindowEnd = std::min(X + window, Width);
+            int WhitePixelCount = 0;
+            for (size_t k = r; k < Runs.size() && Runs[k].Start < WindowEnd; ++k) {
+                WhitePixelCount += std::min(WindowEnd, Runs[k].End()) - std::max(X, Runs[k].Start);
+            }
+            if (WhitePixelCount > threshold) {
+                return X;
             }
         }
     }
+    return -1;
+}
+
+inline float GetAnswer(RTTEX& Image) {
+    const uint32_t WhiteColor = 0xFFFFFFFF;
+
+    int RealWidth = Image.Info.RealWidth;
+    int Width = Image.Info.Width;
+    int X, Y;
+    bool Found;
+
+    if (Image.IsLazy()) {
+        // Index each row as the scan reaches it, decoding it first. Each
+        // thread reuses one index's buffers for every row it takes.
+        Found = ParallelFindFirst(CaptchaOptions.SearchPool.get(), 0, Image.Info.RealHeight, CaptchaOptions.SearchTileRows, [&](int Row) {
+            thread_local RunIndex Whites;
+            Whites.Build(*Image.GetRows(Row, Row + 1), WhiteColor, Row + 1, Row);
+            return FindWhiteBar(Whites, Row, RealWidth, Width);
+        }, X, Y);
+    } else {
+        RunIndex Whites(*Image.GetMap(), WhiteColor, Image.Info.RealHeight);
+        Found = ParallelFindFirst(CaptchaOptions.SearchPool.get(), 0, Image.Info.RealHeight, CaptchaOptions.SearchTileRows,
+                                  [&](int Row) { return FindWhiteBar(Whites, Row, RealWidth, Width); }, X, Y);
+    }
+
+    if (Found) {
+        return static_cast<float>(X) / Image.Info.Width;
+    }
     return 0.0f;
 }
 
-void MakeBrighter(RGB_A& toChange) {
-    auto Brighten = [](uint8_t& channel) {
-        channel = std::min(255, static_cast<int>(channel + ((-166.f * channel / 255.f) + 166.f)));
-    };
-    Brighten(toChange.r);
-    Brighten(toChange.g);
-    Brighten(toChange.b);
+// The brighten curve for every channel value, evaluated once at compile time.
+constexpr std::array<uint8_t, 256> BrightenTable = [] {
+    std::array<uint8_t, 256> Table{};
+    for (int channel = 0; channel < 256; ++channel) {
+        Table[channel] = static_cast<uint8_t>(std::min(255, static_cast<int>(channel + ((-166.f * channel / 255.f) + 166.f))));
+    }
+    return Table;
+}();
+
+inline void MakeBrighter(RGB_A& toChange) {
+    toChange.r = BrightenTable[toChange.r];
+    toChange.g = BrightenTable[toChange.g];
+    toChange.b = BrightenTable[toChange.b];
 }
 
-BitMap* MakeSquare(RTTEX& FROM, const Vector2& Size = Vector2(50, 50), bool makeBright = true) {
-    auto* Map = new BitMap(Size.x, Size.y);
-    int* Bits = Map->GetBitData();
+// OutYStart, when given, receives the texture row the square starts at.
+inline BitMap MakeSquare(RTTEX& FROM, const Vector2& Size = Vector2(50, 50), bool makeBright = true, int* OutYStart = nullptr) {
+    BitMap Map(Size.x, Size.y);
+    RGB_A* Bits = Map.Row<RGBA8>(0).data();
     BitMap* FileMap = FROM.GetMap();
     int xStart = 24;
     int yStart = 0;
+    int Rows = std::min(FROM.Info.RealHeight, FROM.Info.Height);
+    int Columns = std::min(FROM.Info.RealWidth, FROM.Info.Width);
 
-    for (int y = 0; y < FROM.Info.RealHeight && !yStart; ++y) {
-        for (int x = 0; x < FROM.Info.RealWidth; ++x) {
-            if (FileMap->GetPixelRGBA(x, y).r == 255) {
+    for (int y = 0; y < Rows && !yStart; ++y) {
+        const RGB_A* Row = FileMap->Row<RGBA8>(y).data();
+        for (int x = 0; x < Columns; ++x) {
+            if (Row[x].r == 255) {
                 yStart = 20 + y;
                 break;
             }
         }
     }
 
+    // Pieces also arrive from other processes through SolverService, so one
+    // too small for its square is refused rather than read past its end.
+    if (yStart + 50 > Rows || xStart + 50 > FROM.Info.Width) {
+        throw std::runtime_error("Puzzle piece too small for its square");
+    }
+
     for (int Y_POS = yStart; Y_POS < yStart + 50; ++Y_POS) {
+        const RGB_A* Row = FileMap->Row<RGBA8>(Y_POS).data();
         for (int X_POS = xStart; X_POS < xStart + 50; ++X_POS) {
-            RGB_A rgba = FileMap->GetPixelRGBA(X_POS, Y_POS);
+            RGB_A rgba = Row[X_POS];
             if (makeBright)
                 MakeBrighter(rgba);
-            *Bits++ = *reinterpret_cast<int*>(&rgba);
+            *Bits++ = rgba;
         }
     }
 
+    if (OutYStart) *OutYStart = yStart;
     return Map;
 }
 
-bool isNearEquation(const RGB_A& Original, const RGB_A& Color) {
-    return std::abs(Original.r - Color.r) < 3 &&
-           std::abs(Original.g - Color.g) < 3 &&
-           std::abs(Original.b - Color.b) < 3;
+// Exact search of rows [YBegin, YEnd), origins limited to the unpadded width.
+// Coarse is the half-resolution level CoarseToFine scans, built by the caller
+// once per background; CoarseBoxFiltered says it came from HalfSize.
+inline bool FindExact(RTTEX& image, const PieceModel& Piece, int YBegin, int YEnd, int& X, int& Y, BitMap* Coarse = nullptr,
+                      bool CoarseBoxFiltered = false) {
+    const PieceTemplate& Template = Piece.Template;
+    if (CaptchaOptions.CoarseToFine) {
+        return FindPiecePyramid(*image.GetMap(), image.Info.RealWidth, YBegin, YEnd, Template, X, Y, Coarse, &Piece.Halves, CoarseBoxFiltered);
+    }
+    if (LumaPlane* Luma = CaptchaOptions.LumaPrefilter ? image.GetLuma() : nullptr) {
+        LumaScanner Scanner(*image.GetMap(), *Luma, image.Info.RealWidth, Template);
+        return ParallelFindFirst(CaptchaOptions.SearchPool.get(), YBegin, YEnd, CaptchaOptions.SearchTileRows, Scanner, X, Y);
+    }
+    // Windows reach Template.Rows rows down, plus one when they wrap.
+    PieceScanner Scanner(*image.GetRows(YBegin, YEnd + Template.Rows + 1), image.Info.RealWidth, Template);
+    return ParallelFindFirst(CaptchaOptions.SearchPool.get(), YBegin, YEnd, CaptchaOptions.SearchTileRows, Scanner, X, Y);
+}
+
+// Band around the square's row first, then the rows above and below it.
+inline bool FindExact(RTTEX& image, const PieceModel& Piece, int& X, int& Y) {
+    // One coarse level for every band: the file's mip when asked for and
+    // usable, else a box-filtered half built here.
+    std::unique_ptr<BitMap> Half;
+    BitMap* Coarse = nullptr;
+    bool BoxFiltered = false;
+    if (CaptchaOptions.CoarseToFine) {
+        BitMap& Full = *image.GetMap();
+        Coarse = CaptchaOptions.UseFileMips ? image.GetMip(1) : nullptr;
+        if (!Coarse || !IsHalfOf(*Coarse, Full)) {
+            Half = HalfSize(Full);
+            Coarse = Half.get();
+            BoxFiltered = true;
+        }
+    }
+
+    int Height = image.Info.RealHeight;
+    if (!CaptchaOptions.GeometryBand || Piece.SquareY < 0) {
+        return FindExact(image, Piece, 0, Height, X, Y, Coarse, BoxFiltered);
+    }
+
+    int Center = Piece.SquareY + PieceTemplate::Border;
+    int BandBegin = std::clamp(Center - CaptchaOptions.BandMargin, 0, Height);
+    int BandEnd = std::clamp(Center + CaptchaOptions.BandMargin + 1, BandBegin, Height);
+    if (FindExact(image, Piece, BandBegin, BandEnd, X, Y, Coarse, BoxFiltered)) return true;
+
+    CaptchaLog("Nothing in rows %d-%d, scanning the rest.\n", BandBegin, BandEnd);
+    return FindExact(image, Piece, 0, BandBegin, X, Y, Coarse, BoxFiltered) || FindExact(image, Piece, BandEnd, Height, X, Y, Coarse, BoxFiltered);
 }
 
-float AnswerByEquation(RTTEX& image, BitMap* Square) {
+inline bool FindCorrelated(RTTEX& image, const PieceModel& Piece, int& X, int& Y, float* Score = nullptr) {
+    std::unique_ptr<LumaPlane> Built;
+    LumaPlane* Luma = image.GetLuma();
+    if (!Luma) {
+        Built = std::make_unique<LumaPlane>(*image.GetMap());
+        Luma = Built.get();
+    }
+
+    CorrelationMatch Match = FindByCorrelation(*Luma, image.Info.RealWidth, image.Info.RealHeight, Piece.Patch);
+    CaptchaLog("Correlation peak (%d, %d) scored %.3f\n", Match.X, Match.Y, Match.Score);
+    if (Match.X < 0 || Match.Score < CaptchaOptions.MinCorrelation) return false;
+
+    X = Match.X;
+    Y = Match.Y;
+    if (Score) *Score = Match.Score;
+    return true;
+}
+
+inline float PieceAnswer(int X) {
+    return static_cast<float>(X - 28) / 512;
+}
+
+// Confidence, when given, receives 1 for an exact match or the correlation score.
+inline float AnswerByEquation(RTTEX& image, const PieceModel& Piece, float* Confidence = nullptr) {
+    StageTimer Timer(CaptchaMetrics(), SolveStage::Match);
+    int X, Y;
+    bool Found = false;
+    if (Confidence) *Confidence = 1.0f;
+    if (CaptchaOptions.Engine != MatchEngine::Correlation) {
+        Found = FindExact(image, Piece, X, Y);
+    }
+    if (!Found && CaptchaOptions.Engine != MatchEngine::Exact) {
+        Found = FindCorrelated(image, Piece, X, Y, Confidence);
+    }
+
+    if (Found) {
+        CaptchaLog("Solved Piece Location (%d, %d)\n", X, Y);
+        return PieceAnswer(X);
+    }
+    return 0.0f;
+}
+
+inline float AnswerByEquation(RTTEX& image, BitMap* Square, bool PieceAlpha = true) {
     if (!Square) return 0.0f;
+    return AnswerByEquation(image, PieceModel(PieceTemplate(*Square, PieceAlpha), CorrelationPatch(*Square, PieceTemplate::Border)));
+}
 
-    BitMap* ImageMap = image.GetMap();
-
-    for (int Y = 0; Y < image.Info.RealHeight; ++Y) {
-        for (int X = 0; X < image.Info.RealWidth; ++X) {
-            if (isNearEquation(ImageMap->GetPixelRGBA(X, Y), Square->GetPixelRGBA(12, 12))) {
-                int MatchCount = 0;
-                bool matched = true;
-                for (int y = 12; y < Square->Height - 12 && matched; ++y) {
-                    for (int x = 12; x < Square->Width - 12; ++x) {
-                        if (!isNearEquation(ImageMap->GetPixelRGBA(X + x - 12, Y + y - 12), Square->GetPixelRGBA(x, y))) {
-                            matched = false;
-                            break;
-                        }
-                        if (++MatchCount > 200) {
-                            printf("[CAPTCHA]: Solved Piece Location (%d, %d)\n", X, Y);
-                            return static_cast<float>(X - 28) / 512;
-                        }
-                    }
-                }
+// Decodes a downloaded piece into its model, or takes it from the cache.
+inline std::shared_ptr<const PieceModel> LoadPiece(std::span<const uint8_t> Data, const std::string& Url) {
+    PieceCache* Cache = CaptchaOptions.Pieces.get();
+    uint64_t Hash = HashBytes(Data);
+    if (Cache) {
+        if (auto Model = Cache->Find(Hash)) {
+            Cache->Insert(Hash, Url, Model);
+            return Model;
+        }
+    }
+
+    // Decoding the piece, cutting the square and building the model.
+    StageTimer Timer(CaptchaMetrics(), SolveStage::MakeSquare);
+    RTTEX PuzzlePiece(Data);
+    int SquareY;
+    BitMap Square = MakeSquare(PuzzlePiece, Vector2(50, 50), true, &SquareY);
+    auto Model = std::make_shared<PieceModel>(PieceTemplate(Square, PuzzlePiece.Info.useAlpha), CorrelationPatch(Square, PieceTemplate::Border));
+    Model->SquareY = SquareY;
+    if (CaptchaOptions.Recorder) Model->Source.assign(Data.begin(), Data.end());
+
+    if (Cache) Cache->Insert(Hash, Url, Model);
+    return Model;
+}
+
+// Solves a background while it downloads. RTTEX stores rows bottom-up, so each
+// band is scanned for the white bar, and for the piece once its model is set,
+// as soon as the band and every row below it are decoded. A match in a band
+// above replaces one found below, so once every row is in the answers are the
+// ones GetAnswer and the exact engine give. Safe to feed from the fetcher's
+// thread while another sets the piece.
+class StreamSolver {
+private:
+    std::mutex Lock;
+    RTTEXStream Decoder;
+    std::shared_ptr<const PieceModel> Piece;
+    bool EarlyExit;
+    bool Failed = false;
+    // Rows [WhiteFrom, end) were scanned for the bar and piece origins
+    // [PieceFrom, end) were tried; -1 before the header is in.
+    int WhiteFrom = -1;
+    int PieceFrom = -1;
+    int WhiteX = -1;
+    int PieceX = -1;
+    steady_clock::duration DecodeTime{}, WhiteTime{}, PieceTime{};
+
+public:
+    explicit StreamSolver(bool EarlyExit) : EarlyExit(EarlyExit) { }
+
+    // The piece search needs the whole image unless it is the plain exact scan.
+    static bool StreamsPiece() {
+        return !CaptchaOptions.CoarseToFine && !CaptchaOptions.LumaPrefilter && CaptchaOptions.Engine != MatchEngine::Correlation;
+    }
+
+    // The next bytes of the background. True once EarlyExit found a white bar
+    // and the rest of the download isn't needed.
+    bool Push(std::span<const uint8_t> Chunk) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (Failed || Found()) return Found();
+
+        auto Start = steady_clock::now();
+        try {
+            Decoder.Push(Chunk);
+        } catch (const std::exception& e) {
+            // The whole body is decoded again once it is in, which reports it.
+            CaptchaLog("Streamed decode stopped: %s\n", e.what());
+            Failed = true;
+            return false;
+        }
+        DecodeTime += steady_clock::now() - Start;
+        Scan();
+        return Found();
+    }
+
+    // Searches the rows decoded so far for Model and the rest as they arrive.
+    // Only the first model set is used.
+    void SetPiece(std::shared_ptr<const PieceModel> Model) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (Piece || !StreamsPiece()) return;
+        Piece = std::move(Model);
+        Scan();
+    }
+
+    // Sets the piece if it wasn't, then true with X set (-1 for no match) when
+    // the whole background has been searched for it.
+    bool SearchPiece(std::shared_ptr<const PieceModel> Model, int& X) {
+        SetPiece(std::move(Model));
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (!Piece || Failed || !Decoder.Complete() || PieceFrom != 0) return false;
+        X = PieceX;
+        return true;
+    }
+
+    std::shared_ptr<const PieceModel> GetPiece() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Piece;
+    }
+
+    // Every row arrived and was decoded.
+    bool Complete() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return !Failed && Decoder.Complete();
+    }
+
+    // EarlyExit found a white bar.
+    bool Answered() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Found();
+    }
+
+    // The white bar answer, 0 for none. Final once Complete() or Answered().
+    float WhiteAnswer() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return White();
+    }
+
+    std::shared_ptr<RTTEX> GetImage() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        return Decoder.GetImage();
+    }
+
+    // Time spent decoding, scanning for the bar and matching the piece.
+    void Record(SolverMetrics* Metrics, bool Background, bool Match) {
+        if (!Metrics) return;
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (Background) {
+            Metrics->Record(SolveStage::Decode, DecodeTime);
+            Metrics->Record(SolveStage::GetAnswer, WhiteTime);
+        }
+        if (Match) Metrics->Record(SolveStage::Match, PieceTime);
+    }
+
+private:
+    bool Found() const {
+        return EarlyExit && WhiteX >= 0;
+    }
+
+    float White() const {
+        return WhiteX >= 0 ? static_cast<float>(WhiteX) / Decoder.GetImage()->Info.Width : 0.0f;
+    }
+
+    // Scans whatever became searchable, a tile of rows at a time until the
+    // last rows are in. Called under Lock.
+    void Scan() {
+        std::shared_ptr<RTTEX> Image = Decoder.GetImage();
+        if (!Image || Found()) return;
+
+        int Height = std::min(Image->Info.RealHeight, Image->Info.Height);
+        if (WhiteFrom < 0) WhiteFrom = PieceFrom = Height;
+        int Ready = Decoder.FirstRow();
+        int TileRows = std::max(1, CaptchaOptions.SearchTileRows);
+        bool Last = Decoder.Complete();
+        int X, Y;
+
+        if (WhiteFrom > Ready && (Last || WhiteFrom - Ready >= TileRows)) {
+            auto Start = steady_clock::now();
+            BitMap& Map = *Image->GetMap();
+            int RealWidth = Image->Info.RealWidth;
+            int Width = Image->Info.Width;
+            // Rows may run on pool threads; each thread reuses one index's
+            // buffers for every row it takes, as in the lazy GetAnswer.
+            if (ParallelFindFirst(CaptchaOptions.SearchPool.get(), Ready, WhiteFrom, TileRows, [&](int Row) {
+                    thread_local RunIndex Whites;
+                    Whites.Build(Map, 0xFFFFFFFF, Row + 1, Row);
+                    return FindWhiteBar(Whites, Row, RealWidth, Width);
+                }, X, Y)) {
+                WhiteX = X;
             }
+            WhiteFrom = Ready;
+            WhiteTime += steady_clock::now() - Start;
+        }
+
+        // Once there is a white bar the piece doesn't matter.
+        if (Piece && WhiteX < 0 && PieceFrom > Ready && (Last || PieceFrom - Ready >= TileRows)) {
+            auto Start = steady_clock::now();
+            if (FindExact(*Image, *Piece, Ready, PieceFrom, X, Y)) PieceX = X;
+            PieceFrom = Ready;
+            PieceTime += steady_clock::now() - Start;
         }
     }
-    return 0.0f;
+};
+
+inline Fetcher& GetFetcher() {
+    if (CaptchaOptions.Http) return *CaptchaOptions.Http;
+#ifdef _WIN32
+    static WinHttpFetcher Default;
+    return Default;
+#else
+    throw std::runtime_error("No fetcher configured");
+#endif
+}
+
+inline std::string CaptchaReply(float Answer, std::string_view CaptchaID) {
+    std::string Reply = "action|dialog_return\ndialog_name|puzzle_captcha_submit\ncaptcha_answer|" + std::to_string(Answer) + "|CaptchaID|";
+    return Reply.append(CaptchaID);
+}
+
+// One solve, split into stages so CaptchaSolver can run them as separate
+// tasks: StartCaptcha kicks off the downloads, SolveBackground runs once the
+// background is in, SolvePiece once the piece is, and FinishCaptcha builds
+// the reply.
+struct CaptchaJob {
+    high_resolution_clock::time_point Start;
+    // The add_puzzle_captcha values: background file, piece file, host, captcha ID.
+    std::array<std::string, 4> Fields;
+    std::string PieceLink;
+    std::shared_ptr<FetchRequest> Background, Piece;
+    std::shared_ptr<const PieceModel> CachedPiece;
+    std::shared_ptr<StreamSolver> Stream;
+    std::shared_ptr<RTTEX> Image;
+    uint64_t BackgroundHash = 0;
+    float Answer = 0.0f;
+    float Confidence = 1.0f;
+    bool Cached = false;
+    bool Failed = false;
+};
+
+// Decodes a background the way the solver options ask for. A lazy texture
+// reads from Data until it is destroyed, so Data must outlive it.
+inline std::unique_ptr<RTTEX> OpenBackground(std::span<const uint8_t> Data) {
+    // With LazyDecode this is only the header; rows are decoded, and timed,
+    // as part of the searches.
+    StageTimer Timer(CaptchaMetrics(), SolveStage::Decode);
+    if (CaptchaOptions.LazyDecode && !CaptchaOptions.CoarseToFine && !CaptchaOptions.LumaPrefilter) {
+        return std::make_unique<RTTEX>(Data, RTTEX::Lazy);
+    }
+    return std::make_unique<RTTEX>(Data, CaptchaOptions.CoarseToFine && CaptchaOptions.UseFileMips,
+                                   CaptchaOptions.LumaPrefilter && !CaptchaOptions.CoarseToFine);
 }
 
-std::string SolveCaptcha(variant_t& variant) {
-    auto start = high_resolution_clock::now();
+// False when the dialog couldn't be parsed or nothing could be fetched.
+inline bool StartCaptcha(const variant_t& variant, CaptchaJob& Job) {
+    Job.Start = high_resolution_clock::now();
+    CountOutcome(SolveCounter::Solves);
 
-    rtvar parse = rtvar::parse(variant.get_string());
-    std::vector<std::string> Values = parse.find("add_puzzle_captcha")->m_values;
-    std::string DownloadLink = "https://" + Values[2] + "/" + Values[0];
-    std::string PuzzlePieceLink = "https://" + Values[2] + "/" + Values[1];
-    std::string FilePath = "captcha" + Values[3] + ".rttex";
-    std::string PuzzleFilePath = "piece" + Values[3] + ".rttex";
+    try {
+        if (!rtvar_view::find_values(variant.get_string_view(), "add_puzzle_captcha", Job.Fields)) {
+            throw std::runtime_error("Missing add_puzzle_captcha");
+        }
 
-    char Dir[MAX_PATH];
-    GetCurrentDirectory(MAX_PATH, Dir);
+        std::string DownloadLink = CaptchaOptions.Scheme;
+        DownloadLink.append(Job.Fields[2]).append("/").append(Job.Fields[0]);
+        Job.PieceLink = CaptchaOptions.Scheme;
+        Job.PieceLink.append(Job.Fields[2]).append("/").append(Job.Fields[1]);
 
-    std::string ExactFilePath = std::string(Dir) + "\\" + FilePath;
-    std::string ExactPuzzlePath = std::string(Dir) + "\\" + PuzzleFilePath;
+        CaptchaLog("Downloading From: %s\n", DownloadLink.c_str());
 
-    printf("[CAPTCHA]: Downloading From: %s\n", DownloadLink.c_str());
+        if (CaptchaOptions.KeyPiecesByUrl && CaptchaOptions.Pieces) {
+            Job.CachedPiece = CaptchaOptions.Pieces->FindUrl(Job.PieceLink);
+        }
 
-    if (SUCCEEDED(URLDownloadToFile(NULL, DownloadLink.c_str(), ExactFilePath.c_str(), 0, NULL))) {
-        printf("[CAPTCHA]: Download succeeded.\n");
-        RTTEX Image(FilePath.c_str());
+        // The piece is only needed when GetAnswer fails, but fetching it alongside
+        // the background hides its round trip; it is cancelled if unused.
+        Job.Background = GetFetcher().Fetch(DownloadLink);
+        if (!Job.CachedPiece) Job.Piece = GetFetcher().Fetch(Job.PieceLink);
+    } catch (const std::exception& e) {
+        CaptchaLog("%s.\n", e.what());
+        if (Job.Background) Job.Background->Cancel();
+        CountOutcome(SolveCounter::Failures);
+        return false;
+    }
 
-        float Answer = GetAnswer(Image);
+    // Download times run from here to completion, on whichever thread completes them.
+    if (SolverMetrics* Metrics = CaptchaMetrics()) {
+        auto Record = [Metrics, Start = steady_clock::now()](SolveStage Stage) {
+            return [Metrics, Start, Stage](FetchRequest& Request) {
+                if (Request.Result()) Metrics->Record(Stage, steady_clock::now() - Start);
+            };
+        };
+        Job.Background->OnComplete(Record(SolveStage::FetchBackground));
+        if (Job.Piece) Job.Piece->OnComplete(Record(SolveStage::FetchPiece));
+    }
 
-        if (Answer == 0.0f) {
-            printf("[CAPTCHA]: Downloading From: %s\n", PuzzlePieceLink.c_str());
-            if (SUCCEEDED(URLDownloadToFile(NULL, PuzzlePieceLink.c_str(), ExactPuzzlePath.c_str(), 0, NULL))) {
-                printf("[CAPTCHA]: Downloaded Puzzle Piece.\n");
-                auto m_start = high_resolution_clock::now();
-                RTTEX PuzzlePiece(PuzzleFilePath.c_str());
-                BitMap* Square = MakeSquare(PuzzlePiece);
-                Answer = AnswerByEquation(Image, Square);
-                auto m_end = high_resolution_clock::now();
-                if (Answer != 0.0f) {
-                    printf("[CAPTCHA]: Matched Pattern (in %.2f milliseconds)!\n", duration<double, std::milli>(m_end - m_start).count());
+    if (CaptchaOptions.StreamDecode) {
+        auto Stream = Job.Stream = std::make_shared<StreamSolver>(CaptchaOptions.StreamEarlyExit);
+        if (Job.CachedPiece) Stream->SetPiece(Job.CachedPiece);
+        Job.Background->OnData([Stream](FetchRequest& Request, std::span<const uint8_t> Chunk) {
+            if (Stream->Push(Chunk)) Request.Cancel();
+        });
+        // SolvePiece reports a piece that fails to load.
+        if (Job.Piece && StreamSolver::StreamsPiece()) {
+            Job.Piece->OnComplete([Stream, Url = Job.PieceLink](FetchRequest& Request) {
+                const std::vector<uint8_t>* Data = Request.Result();
+                if (!Data) return;
+                try {
+                    Stream->SetPiece(LoadPiece(*Data, Url));
+                } catch (const std::exception&) {
                 }
-                delete Square;
+            });
+        }
+    }
+    return true;
+}
+
+// Call once Background has completed. True when the white bar wasn't there
+// and the piece has to be matched.
+inline bool SolveBackground(CaptchaJob& Job) {
+    // StreamEarlyExit found the bar and cancelled the rest of the download.
+    if (Job.Stream && Job.Stream->Answered()) {
+        if (Job.Piece) Job.Piece->Cancel();
+        Job.Answer = Job.Stream->WhiteAnswer();
+        Job.Stream->Record(CaptchaMetrics(), true, false);
+        CountOutcome(SolveCounter::WhiteBar);
+        CaptchaLog("Found the white bar before the download finished.\n");
+        return false;
+    }
+
+    const std::vector<uint8_t>* ImageData = Job.Background->Result();
+    if (!ImageData) {
+        if (Job.Piece) Job.Piece->Cancel();
+        CaptchaLog("File couldn't download.\n");
+        Job.Failed = true;
+        return false;
+    }
+
+    CaptchaLog("Download succeeded.\n");
+
+    if (CaptchaOptions.Answers) {
+        Job.BackgroundHash = HashBytes(*ImageData);
+        CachedAnswer Hit;
+        if (CaptchaOptions.Answers->Find(Job.BackgroundHash, Hit) && Hit.Answer != 0.0f &&
+            Hit.Confidence >= CaptchaOptions.MinCachedConfidence) {
+            if (Job.Piece) Job.Piece->Cancel();
+            CaptchaLog("Answer cached.\n");
+            Job.Answer = Hit.Answer;
+            Job.Confidence = Hit.Confidence;
+            Job.Cached = true;
+            CountOutcome(SolveCounter::CachedAnswers);
+            return false;
+        }
+    }
+
+    try {
+        if (Job.Stream && Job.Stream->Complete()) {
+            // Decoded and scanned while downloading.
+            Job.Image = Job.Stream->GetImage();
+            Job.Answer = Job.Stream->WhiteAnswer();
+            Job.Stream->Record(CaptchaMetrics(), true, false);
+        } else {
+            // Job.Background, which owns the bytes, outlives Job.Image.
+            Job.Image = OpenBackground(*ImageData);
+            StageTimer Timer(CaptchaMetrics(), SolveStage::GetAnswer);
+            Job.Answer = GetAnswer(*Job.Image);
+        }
+    } catch (const std::exception& e) {
+        if (Job.Piece) Job.Piece->Cancel();
+        CaptchaLog("Failed to decode texture: %s\n", e.what());
+        Job.Failed = true;
+        return false;
+    }
+
+    if (Job.Answer != 0.0f) {
+        if (Job.Piece) Job.Piece->Cancel();
+        CountOutcome(SolveCounter::WhiteBar);
+        return false;
+    }
+    CountOutcome(SolveCounter::PieceFallbacks);
+    return true;
+}
+
+// Call once Piece has completed, or right away when the model was cached.
+inline void SolvePiece(CaptchaJob& Job) {
+    const std::vector<uint8_t>* PieceData = Job.Piece ? Job.Piece->Result() : nullptr;
+    if (PieceData) {
+        CaptchaLog("Downloaded Puzzle Piece.\n");
+    }
+
+    try {
+        auto m_start = high_resolution_clock::now();
+        std::shared_ptr<const PieceModel> Model = Job.CachedPiece ? Job.CachedPiece : Job.Stream ? Job.Stream->GetPiece() : nullptr;
+        if (!Model && PieceData) Model = LoadPiece(*PieceData, Job.PieceLink);
+
+        int X;
+        if (Model && Job.Stream && Job.Stream->SearchPiece(Model, X)) {
+            // The exact scan ran while downloading; only correlation is left.
+            int Y;
+            Job.Stream->Record(CaptchaMetrics(), false, true);
+            if (X < 0 && CaptchaOptions.Engine == MatchEngine::ExactThenCorrelation) {
+                StageTimer Timer(CaptchaMetrics(), SolveStage::Match);
+                if (!FindCorrelated(*Job.Image, *Model, X, Y, &Job.Confidence)) X = -1;
             }
+            if (X >= 0) Job.Answer = PieceAnswer(X);
+        } else if (Model) {
+            Job.Answer = AnswerByEquation(*Job.Image, *Model, &Job.Confidence);
+        }
+        auto m_end = high_resolution_clock::now();
+        if (Job.Answer != 0.0f) {
+            CaptchaLog("Matched Pattern (in %.2f milliseconds)!\n", duration<double, std::milli>(m_end - m_start).count());
         }
+    } catch (const std::exception& e) {
+        CaptchaLog("Failed to decode texture: %s\n", e.what());
+        Job.Failed = true;
+    }
+}
+
+// The whole solve for textures already in memory, without the dialog or any
+// download. An empty Piece is looked up by PieceUrl with KeyPiecesByUrl, as
+// StartCaptcha does; without a model only the white bar can answer.
+inline float SolveTextures(std::span<const uint8_t> Background, std::span<const uint8_t> Piece, const std::string& PieceUrl) {
+    std::unique_ptr<RTTEX> Image = OpenBackground(Background);
+    float Answer;
+    {
+        StageTimer Timer(CaptchaMetrics(), SolveStage::GetAnswer);
+        Answer = GetAnswer(*Image);
+    }
+    if (Answer != 0.0f) return Answer;
 
-        std::remove(FilePath.c_str());
-        std::remove(PuzzleFilePath.c_str());
+    std::shared_ptr<const PieceModel> Model;
+    if (!Piece.empty()) {
+        Model = LoadPiece(Piece, PieceUrl);
+    } else if (CaptchaOptions.KeyPiecesByUrl && CaptchaOptions.Pieces) {
+        Model = CaptchaOptions.Pieces->FindUrl(PieceUrl);
+    }
+    return Model ? AnswerByEquation(*Image, *Model) : 0.0f;
+}
 
-        auto end = high_resolution_clock::now();
+inline std::string FinishCaptcha(CaptchaJob& Job) {
+    Job.Image.reset();
+    Job.Stream.reset();
+    if (Job.Failed) {
+        CountOutcome(SolveCounter::Failures);
+        return "";
+    }
+    if (Job.Answer == 0.0f) CountOutcome(SolveCounter::ZeroAnswers);
 
-        printf("[CAPTCHA]: Downloaded & Solved in %.2f milliseconds.\n", duration<double, std::milli>(end - start).count());
-        return "action|dialog_return\ndialog_name|puzzle_captcha_submit\ncaptcha_answer|" + std::to_string(Answer) + "|CaptchaID|" + Values[3];
+    // An early streamed answer has no complete background to key or record.
+    const std::vector<uint8_t>* Background = Job.Background->Result();
+    if (CaptchaOptions.Answers && !Job.Cached && Job.Answer != 0.0f && Background) {
+        CaptchaOptions.Answers->Insert(Job.BackgroundHash, { Job.Answer, Job.Confidence });
     }
 
-    printf("[CAPTCHA]: File couldn't download.\n");
-    std::remove(FilePath.c_str());
-    return "";
+    if (CaptchaOptions.Recorder && Background) {
+        const std::vector<uint8_t>* Piece = Job.Piece ? Job.Piece->Result() : nullptr;
+        CorpusEntry Entry;
+        Entry.Background = *Background;
+        // A URL hit skipped the download; the model kept the bytes.
+        if (Piece) {
+            Entry.Piece = *Piece;
+        } else if (Job.CachedPiece) {
+            Entry.Piece = Job.CachedPiece->Source;
+        }
+        for (size_t i = 0; i < Job.Fields.size(); ++i) {
+            Entry.Fields[i] = Job.Fields[i];
+        }
+        Entry.Answer = Job.Answer;
+        try {
+            CaptchaOptions.Recorder->Append(Entry);
+        } catch (const std::exception& e) {
+            CaptchaLog("Failed to record captcha: %s\n", e.what());
+        }
+    }
+
+    auto end = high_resolution_clock::now();
+
+    CaptchaLog("Downloaded & Solved in %.2f milliseconds.\n", duration<double, std::milli>(end - Job.Start).count());
+    StageTimer Timer(CaptchaMetrics(), SolveStage::Reply);
+    return CaptchaReply(Job.Answer, Job.Fields[3]);
+}
+
+inline std::string SolveCaptcha(variant_t& variant) {
+    CaptchaJob Job;
+    if (!StartCaptcha(variant, Job)) return "";
+
+    Job.Background->Wait();
+    if (SolveBackground(Job)) {
+        if (Job.Piece) Job.Piece->Wait();
+        SolvePiece(Job);
+    }
+    return FinishCaptcha(Job);
 }
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <map>
+#include <array>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include "Socket.h"
+#include "variant2.hpp"
+#include "rtparam.hpp"
+
+// Solver service protocol over a local stream socket. Every message is a
+// SolverFrame followed by Size payload bytes, in host byte order since both
+// ends run on the same machine. Requests carry a caller-chosen Id that the
+// reply repeats; replies may come back in any order.
+//
+// SolverRequest::Dialog payload: uint16_t sizes of the four add_puzzle_captcha
+// fields (background file, piece file, host, captcha ID), then the fields.
+// SolverRequest::Textures payload: uint32_t background and piece sizes, the
+// background bytes, the piece bytes (may be empty), then the captcha ID.
+// SolverRequest::Reply payload: the reply SolveCaptcha would return, empty
+// when the solve failed.
+enum class SolverRequest : uint32_t {
+    Dialog = 1,
+    Textures = 2,
+    Reply = 3
+};
+
+#pragma pack(push, 1)
+
+struct SolverFrame {
+    uint32_t Size;
+    uint32_t Id;
+    SolverRequest Kind;
+};
+
+#pragma pack(pop)
+
+// Larger frames are a protocol error and drop the connection.
+constexpr uint32_t MaxSolverFrame = 64 << 20;
+
+inline bool SendFrame(SocketHandle Socket, uint32_t Id, SolverRequest Kind, std::span<const uint8_t> Payload) {
+    SolverFrame Frame = { static_cast<uint32_t>(Payload.size()), Id, Kind };
+    return SendAll(Socket, &Frame, sizeof(Frame)) && SendAll(Socket, Payload.data(), Payload.size());
+}
+
+inline bool RecvFrame(SocketHandle Socket, SolverFrame& Frame, std::vector<uint8_t>& Payload) {
+    if (!RecvAll(Socket, &Frame, sizeof(Frame)) || Frame.Size > MaxSolverFrame) return false;
+    Payload.resize(Frame.Size);
+    return RecvAll(Socket, Payload.data(), Payload.size());
+}
+
+// Connection to a SolverService. Any number of threads may submit at once;
+// requests are pipelined on the one socket and each future gets its own reply.
+// Once the connection drops, pending and later requests reply "".
+class SolverClient {
+private:
+    SocketHandle Socket;
+    std::mutex SendLock;
+    std::mutex Lock;
+    std::map<uint32_t, std::promise<std::string>> Pending;
+    uint32_t NextId = 0;
+    bool Connected = true;
+    std::thread Reader;
+
+public:
+    explicit SolverClient(const std::string& Path) : Socket(ConnectUnix(Path)) {
+        if (Socket == InvalidSocket) {
+            throw std::runtime_error("Failed to connect to solver service");
+        }
+        Reader = std::thread([this] { Receive(); });
+    }
+
+    ~SolverClient() {
+        ShutdownSocket(Socket);
+        Reader.join();
+        CloseSocket(Socket);
+    }
+
+    SolverClient(const SolverClient&) = delete;
+    SolverClient& operator=(const SolverClient&) = delete;
+
+    // The drop-in for SolveCaptcha.
+    std::string Solve(const variant_t& Dialog) {
+        return Submit(Dialog).get();
+    }
+
+    std::future<std::string> Submit(const variant_t& Dialog) {
+        std::array<std::string, 4> Fields;
+        if (!rtvar_view::find_values(Dialog.get_string_view(), "add_puzzle_captcha", Fields)) return Ready("");
+
+        uint16_t Sizes[4];
+        std::vector<uint8_t> Payload(sizeof(Sizes));
+        for (size_t i = 0; i < 4; ++i) {
+            const std::string& Field = Fields[i];
+            if (Field.size() > UINT16_MAX) return Ready("");
+            Sizes[i] = static_cast<uint16_t>(Field.size());
+            Payload.insert(Payload.end(), Field.begin(), Field.end());
+        }
+        std::memcpy(Payload.data(), Sizes, sizeof(Sizes));
+        return Send(SolverRequest::Dialog, Payload);
+    }
+
+    std::string SolveTextures(std::span<const uint8_t> Background, std::span<const uint8_t> Piece, std::string_view CaptchaID) {
+        return SubmitTextures(Background, Piece, CaptchaID).get();
+    }
+
+    std::future<std::string> SubmitTextures(std::span<const uint8_t> Background, std::span<const uint8_t> Piece, std::string_view CaptchaID) {
+        uint32_t Sizes[2] = { static_cast<uint32_t>(Background.size()), static_cast<uint32_t>(Piece.size()) };
+        std::vector<uint8_t> Payload(sizeof(Sizes));
+        std::memcpy(Payload.data(), Sizes, sizeof(Sizes));
+        Payload.insert(Payload.end(), Background.begin(), Background.end());
+        Payload.insert(Payload.end(), Piece.begin(), Piece.end());
+        Payload.insert(Payload.end(), CaptchaID.begin(), CaptchaID.end());
+        return Send(SolverRequest::Textures, Payload);
+    }
+
+private:
+    static std::future<std::string> Ready(std::string Reply) {
+        std::promise<std::string> Result;
+        Result.set_value(std::move(Reply));
+        return Result.get_future();
+    }
+
+    std::future<std::string> Send(SolverRequest Kind, std::span<const uint8_t> Payload) {
+        if (Payload.size() > MaxSolverFrame) return Ready("");
+
+        uint32_t Id;
+        std::future<std::string> Reply;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (!Connected) return Ready("");
+            Id = NextId++;
+            Reply = Pending[Id].get_future();
+        }
+
+        std::lock_guard<std::mutex> Guard(SendLock);
+        // A failed send ends the connection, which lets Receive answer it.
+        if (!SendFrame(Socket, Id, Kind, Payload)) ShutdownSocket(Socket);
+        return Reply;
+    }
+
+    void Receive() {
+        SolverFrame Frame;
+        std::vector<uint8_t> Payload;
+        while (RecvFrame(Socket, Frame, Payload)) {
+            std::lock_guard<std::mutex> Guard(Lock);
+            auto It = Pending.find(Frame.Id);
+            if (Frame.Kind != SolverRequest::Reply || It == Pending.end()) continue;
+            It->second.set_value(std::string(Payload.begin(), Payload.end()));
+            Pending.erase(It);
+        }
+
+        std::lock_guard<std::mutex> Guard(Lock);
+        Connected = false;
+        for (auto& [Id, Reply] : Pending) {
+            Reply.set_value("");
+        }
+        Pending.clear();
+    }
+};
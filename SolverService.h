@@ -0,0 +1,190 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <condition_variable>
+#include "CaptchaSolver.h"
+#include "SolverClient.h"
+
+// Long-running solver shared by every bot process on a host, listening on a
+// Unix domain socket for SolverClient requests. All connections feed one
+// CaptchaSolver, so concurrent requests share its worker threads and the
+// piece and answer caches in CaptchaOptions instead of each process keeping
+// its own.
+class SolverService {
+private:
+    struct Connection {
+        SocketHandle Socket;
+        std::mutex SendLock;
+        std::thread Reader;
+        std::atomic<bool> Finished{ false };
+
+        explicit Connection(SocketHandle Socket) : Socket(Socket) { }
+
+        // Replies to requests still solving hold the connection, so the
+        // socket is only closed once the last of them is sent.
+        ~Connection() {
+            CloseSocket(Socket);
+        }
+
+        void Reply(uint32_t Id, const std::string& Text) {
+            std::lock_guard<std::mutex> Guard(SendLock);
+            SendFrame(Socket, Id, SolverRequest::Reply, { reinterpret_cast<const uint8_t*>(Text.data()), Text.size() });
+        }
+    };
+
+    std::string Path;
+    UnixSocketFile Bound;
+    SocketHandle Listener = InvalidSocket;
+    std::unique_ptr<CaptchaSolver> Solver;
+    std::thread Acceptor;
+    std::mutex Lock;
+    std::condition_variable Stopped;
+    std::list<std::shared_ptr<Connection>> Connections;
+    std::atomic<bool> Running{ true };
+    std::atomic<uint64_t> RequestCount{ 0 };
+
+public:
+    SolverService(const std::string& Path, int Threads = static_cast<int>(std::thread::hardware_concurrency()))
+        : Path(Path), Solver(std::make_unique<CaptchaSolver>(Threads)) {
+        Listener = ListenUnix(Path, &Bound);
+        // Also fails while another service is listening at Path.
+        if (Listener == InvalidSocket) {
+            throw std::runtime_error("Failed to start solver service");
+        }
+
+        Acceptor = std::thread([this] {
+            for (;;) {
+                SocketHandle Client = accept(Listener, nullptr, nullptr);
+                if (Client == InvalidSocket) {
+                    if (!Running) return;
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> Guard(Lock);
+                if (!Running) {
+                    CloseSocket(Client);
+                    return;
+                }
+                Reap();
+                auto Link = std::make_shared<Connection>(Client);
+                Connections.push_back(Link);
+                Link->Reader = std::thread([this, Link] { Handle(Link); });
+            }
+        });
+    }
+
+    // Stops accepting, drops every client and waits for solves in flight.
+    ~SolverService() {
+        Stop();
+        Acceptor.join();
+
+        std::list<std::shared_ptr<Connection>> Open;
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            for (auto& Link : Connections) {
+                ShutdownSocket(Link->Socket);
+            }
+            Open.swap(Connections);
+        }
+        for (auto& Link : Open) {
+            Link->Reader.join();
+        }
+        Solver.reset();
+        RemoveUnixSocket(Path, Bound);
+    }
+
+    SolverService(const SolverService&) = delete;
+    SolverService& operator=(const SolverService&) = delete;
+
+    void Stop() {
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (!Running.exchange(false)) return;
+        ShutdownSocket(Listener);
+        CloseSocket(Listener);
+        Stopped.notify_all();
+    }
+
+    // Blocks until Stop, for a process that does nothing but serve.
+    void Wait() {
+        std::unique_lock<std::mutex> Guard(Lock);
+        Stopped.wait(Guard, [this] { return !Running; });
+    }
+
+    uint64_t Requests() const {
+        return RequestCount;
+    }
+
+    int Threads() const {
+        return Solver->Size();
+    }
+
+private:
+    // Joins readers whose clients have gone. Called under Lock.
+    void Reap() {
+        for (auto It = Connections.begin(); It != Connections.end();) {
+            if ((*It)->Finished) {
+                (*It)->Reader.join();
+                It = Connections.erase(It);
+            } else {
+                ++It;
+            }
+        }
+    }
+
+    void Handle(std::shared_ptr<Connection> Link) {
+        SolverFrame Frame;
+        std::vector<uint8_t> Payload;
+        while (Running && RecvFrame(Link->Socket, Frame, Payload) && Dispatch(Link, Frame, Payload)) {
+            ++RequestCount;
+        }
+        ShutdownSocket(Link->Socket);
+        Link->Finished = true;
+    }
+
+    // False on a malformed request, which ends the connection.
+    bool Dispatch(const std::shared_ptr<Connection>& Link, const SolverFrame& Frame, std::vector<uint8_t>& Payload) {
+        uint32_t Id = Frame.Id;
+        auto Done = [Link, Id](std::string Reply) { Link->Reply(Id, Reply); };
+
+        if (Frame.Kind == SolverRequest::Dialog) {
+            uint16_t Sizes[4];
+            if (Payload.size() < sizeof(Sizes)) return false;
+            std::memcpy(Sizes, Payload.data(), sizeof(Sizes));
+
+            std::string Dialog = "add_puzzle_captcha";
+            size_t At = sizeof(Sizes);
+            for (uint16_t Size : Sizes) {
+                if (Payload.size() - At < Size) return false;
+                Dialog.append("|").append(reinterpret_cast<const char*>(Payload.data() + At), Size);
+                At += Size;
+            }
+            Solver->Submit(variant_t(Dialog), Done);
+            return true;
+        }
+
+        if (Frame.Kind == SolverRequest::Textures) {
+            uint32_t Sizes[2];
+            if (Payload.size() < sizeof(Sizes)) return false;
+            std::memcpy(Sizes, Payload.data(), sizeof(Sizes));
+            size_t Textures = sizeof(Sizes) + static_cast<size_t>(Sizes[0]) + Sizes[1];
+            if (Payload.size() < Textures) return false;
+
+            auto Begin = Payload.begin() + sizeof(Sizes);
+            std::vector<uint8_t> Background(Begin, Begin + Sizes[0]);
+            std::vector<uint8_t> Piece(Begin + Sizes[0], Begin + Sizes[0] + Sizes[1]);
+            std::string CaptchaID(Payload.begin() + Textures, Payload.end());
+            Solver->SubmitTextures(std::move(Background), std::move(Piece), std::move(CaptchaID), Done);
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <vector>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+#include "RTTEX.h"
+#include "RowDecode.h"
+#include "TextureReader.h"
+
+// Push decoder for textures arriving in pieces. Push takes the file, or its
+// RTPACK, in chunks of any size and decodes every row whose bytes are all in
+// right away. Rows are stored bottom-up, so the decoded rows are always
+// [FirstRow(), Height). Only the main image is decoded; anything after it,
+// such as mips, is ignored.
+class RTTEXStream {
+private:
+    enum class Container {
+        Unknown,
+        Raw,
+        Packed
+    };
+
+    Container Format = Container::Unknown;
+    // Container header bytes until the format is known.
+    std::vector<uint8_t> Head;
+    z_stream Inflate = {};
+    bool Inflating = false;
+    std::vector<uint8_t> Inflated;
+
+    // RTTEX header or partial row carried over to the next chunk.
+    std::vector<uint8_t> Carry;
+    std::shared_ptr<RTTEX> Image;
+    RowDecoder DecodeRow = nullptr;
+    size_t RowBytes = 0;
+    int Rows = 0;
+
+public:
+    RTTEXStream() = default;
+
+    ~RTTEXStream() {
+        if (Inflating) inflateEnd(&Inflate);
+    }
+
+    RTTEXStream(const RTTEXStream&) = delete;
+    RTTEXStream& operator=(const RTTEXStream&) = delete;
+
+    // Throws on a malformed texture, like RTTEX's decode.
+    void Push(std::span<const uint8_t> Chunk) {
+        if (Complete() || Chunk.empty()) return;
+
+        if (Format == Container::Unknown) {
+            size_t Take = std::min(Chunk.size(), sizeof(RTPACKHEADER) - Head.size());
+            Head.insert(Head.end(), Chunk.begin(), Chunk.begin() + Take);
+            Chunk = Chunk.subspan(Take);
+            if (Head.size() < sizeof(RTPACKHEADER)) return;
+
+            if (IsRTPACK(Head)) {
+                RTPACKHEADER Header;
+                std::memcpy(&Header, Head.data(), sizeof(Header));
+                if (Header.CompressionType != 1) {
+                    throw std::runtime_error("Unsupported RTPACK compression");
+                }
+                if (inflateInit(&Inflate) != Z_OK) {
+                    throw std::runtime_error("Failed to initialize inflate");
+                }
+                Inflating = true;
+                Format = Container::Packed;
+            } else {
+                Format = Container::Raw;
+                Feed(Head);
+            }
+            Head = {};
+        }
+
+        if (Format == Container::Raw) {
+            Feed(Chunk);
+            return;
+        }
+
+        if (Inflated.empty()) Inflated.resize(64 << 10);
+        Inflate.next_in = const_cast<Bytef*>(Chunk.data());
+        Inflate.avail_in = static_cast<uInt>(Chunk.size());
+        while (!Complete()) {
+            Inflate.next_out = Inflated.data();
+            Inflate.avail_out = static_cast<uInt>(Inflated.size());
+            int Result = inflate(&Inflate, Z_NO_FLUSH);
+            if (Result != Z_OK && Result != Z_STREAM_END && Result != Z_BUF_ERROR) {
+                throw std::runtime_error("Corrupt RTPACK data");
+            }
+
+            Feed({ Inflated.data(), Inflated.size() - Inflate.avail_out });
+            // Out of input with nothing left buffered, or the stream ended.
+            if (Result != Z_OK || (Inflate.avail_in == 0 && Inflate.avail_out > 0)) break;
+        }
+    }
+
+    bool HasHeader() const {
+        return Image != nullptr;
+    }
+
+    bool Complete() const {
+        return Image && Rows == Image->Info.Height;
+    }
+
+    // Lowest decoded row; INT_MAX before the header is in.
+    int FirstRow() const {
+        return Image ? Image->Info.Height - Rows : INT_MAX;
+    }
+
+    // Null before the header is in. Rows above FirstRow() hold garbage.
+    std::shared_ptr<RTTEX> GetImage() const {
+        return Image;
+    }
+
+private:
+    // Bytes of the RTTEX file itself, in order.
+    void Feed(std::span<const uint8_t> Bytes) {
+        if (!Image) {
+            size_t Take = std::min(Bytes.size(), RTTEX::HeaderSize - Carry.size());
+            Carry.insert(Carry.end(), Bytes.begin(), Bytes.begin() + Take);
+            Bytes = Bytes.subspan(Take);
+            if (Carry.size() < RTTEX::HeaderSize) return;
+
+            RTTEXINFO Info;
+            RawReader Reader(Carry);
+            RTTEX::ReadHeader(Reader, Info);
+            Image = std::make_shared<RTTEX>(Info);
+            DecodeRow = GetRowDecoder(Info.useAlpha);
+            RowBytes = static_cast<size_t>(Info.Width) * (Info.useAlpha ? 4 : 3);
+            Carry.clear();
+        }
+
+        // Finish the row split across chunks, then decode whole rows in place.
+        if (!Carry.empty()) {
+            size_t Take = std::min(Bytes.size(), RowBytes - Carry.size());
+            Carry.insert(Carry.end(), Bytes.begin(), Bytes.begin() + Take);
+            Bytes = Bytes.subspan(Take);
+            if (Carry.size() < RowBytes) return;
+            NextRow(Carry.data());
+            Carry.clear();
+        }
+        while (!Complete() && Bytes.size() >= RowBytes) {
+            NextRow(Bytes.data());
+            Bytes = Bytes.subspan(RowBytes);
+        }
+        if (!Complete()) Carry.assign(Bytes.begin(), Bytes.end());
+    }
+
+    void NextRow(const uint8_t* Source) {
+        int y = Image->Info.Height - 1 - Rows;
+        DecodeRow(Source, Image->GetMap()->GetBitData(0, y), Image->Info.Width);
+        ++Rows;
+    }
+};
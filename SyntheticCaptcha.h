@@ -0,0 +1,171 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+#include "BitMap.h"
+#include "RTTEX.h"
+#include "SolveCaptcha.h"
+
+struct SyntheticOptions {
+    int Width = 512;
+    int Height = 256;
+    // Unpadded size; 0 takes the full texture.
+    int RealWidth = 0;
+    int RealHeight = 0;
+    bool Alpha = false;
+    // Paint a white bar for GetAnswer instead of relying on the piece.
+    bool WhiteBar = false;
+    // Each background channel moves by up to this much after the piece is
+    // placed. Up to 2 still matches exactly; more needs MatchEngine::Correlation.
+    int Noise = 0;
+    // Wrap both textures in RTPACK.
+    bool Packed = false;
+    uint32_t Seed = 1;
+};
+
+// A background and piece texture pair and the answer the solver should give.
+// X and Y are the piece match origin or the white bar's start.
+struct SyntheticCaptcha {
+    std::vector<uint8_t> Background;
+    std::vector<uint8_t> Piece;
+    float Answer = 0.0f;
+    int X = 0;
+    int Y = 0;
+};
+
+// BitMap back to RTTEX file bytes, the inverse of RTTEX's decode: rows
+// bottom-up, RGBA pixels with the bytes of each 16-bit half swapped, RGB
+// pixels without the fourth byte.
+inline std::vector<uint8_t> EncodeRTTEX(BitMap& Map, int RealWidth, int RealHeight, bool Alpha, bool Packed) {
+    RTTEXINFO Info = {};
+    Info.Height = Map.Height;
+    Info.Width = Map.Width;
+    Info.Format = 5121;
+    Info.RealHeight = RealHeight;
+    Info.RealWidth = RealWidth;
+    Info.useAlpha = Alpha;
+    Info.MipMapCount = 1;
+
+    size_t PixelSize = Alpha ? 4 : 3;
+    std::vector<uint8_t> File(RTTEX::HeaderSize + static_cast<size_t>(Map.Width) * Map.Height * PixelSize);
+    std::memcpy(File.data(), "RTTXTR", 6);
+    std::memcpy(File.data() + 8, &Info, sizeof(Info));
+    RTTEXMIPHEADER Mip = { Map.Height, Map.Width, static_cast<int>(File.size() - RTTEX::HeaderSize), 0, { 0, 0 } };
+    std::memcpy(File.data() + RTTEX::HeaderSize - sizeof(Mip), &Mip, sizeof(Mip));
+
+    uint8_t* Out = File.data() + RTTEX::HeaderSize;
+    for (int y = Map.Height - 1; y >= 0; --y) {
+        const uint8_t* In = Map.GetBitData(0, y);
+        for (int x = 0; x < Map.Width; ++x, In += 4, Out += PixelSize) {
+            if (Alpha) {
+                Out[0] = In[1];
+                Out[1] = In[0];
+                Out[2] = In[3];
+                Out[3] = In[2];
+            } else {
+                std::memcpy(Out, In, 3);
+            }
+        }
+    }
+    if (!Packed) return File;
+
+    uLongf Size = compressBound(static_cast<uLong>(File.size()));
+    std::vector<uint8_t> Pack(sizeof(RTPACKHEADER) + Size);
+    if (compress(Pack.data() + sizeof(RTPACKHEADER), &Size, File.data(), static_cast<uLong>(File.size())) != Z_OK) {
+        throw std::runtime_error("Failed to compress texture");
+    }
+    RTPACKHEADER Header = {};
+    std::memcpy(Header.Magic, "RTPACK", 6);
+    Header.Version = 1;
+    Header.CompressedSize = static_cast<uint32_t>(Size);
+    Header.DecompressedSize = static_cast<uint32_t>(File.size());
+    Header.CompressionType = 1;
+    std::memcpy(Pack.data(), &Header, sizeof(Header));
+    Pack.resize(sizeof(RTPACKHEADER) + Size);
+    return Pack;
+}
+
+// Builds a captcha the way the server's look to the solver. The piece texture
+// has its first r == 255 pixel on a random row, so MakeSquare cuts the square
+// there; the brightened inner window of that square is then painted into the
+// background at the same height. Random channels below 255 keep GetAnswer from
+// seeing a white bar unless WhiteBar asks for one.
+inline SyntheticCaptcha MakeSyntheticCaptcha(const SyntheticOptions& Options) {
+    const int Border = PieceTemplate::Border;
+    const int Side = 50;
+    int RealWidth = Options.RealWidth ? Options.RealWidth : Options.Width;
+    int RealHeight = Options.RealHeight ? Options.RealHeight : Options.Height;
+    if (RealWidth < Side + 24 || RealHeight < Side + 20 + Border + 1 || RealWidth > Options.Width || RealHeight > Options.Height) {
+        throw std::runtime_error("Synthetic captcha too small");
+    }
+
+    std::mt19937 Random(Options.Seed);
+    auto Channel = [&] { return static_cast<uint8_t>(Random() % 255); };
+
+    // RGB pixels decode with r = 255, so their first row is always the mark.
+    BitMap Piece(Options.Height, Options.Width, BitMap::Uninitialized);
+    for (int i = 0; i < Options.Width * Options.Height; ++i) {
+        uint8_t* p = Piece.GetBitData() + i * 4;
+        p[0] = Channel();
+        p[1] = Channel();
+        p[2] = Options.Alpha ? 255 : Channel();
+        p[3] = Options.Alpha ? Channel() : 255;
+    }
+    int Mark = Options.Alpha ? static_cast<int>(Random() % (RealHeight - Side - 20)) : 0;
+    Piece.GetBitData(static_cast<int>(Random() % RealWidth), Mark)[3] = 255;
+    int yStart = 20 + Mark;
+
+    BitMap Background(Options.Height, Options.Width, BitMap::Uninitialized);
+    for (int i = 0; i < Options.Width * Options.Height; ++i) {
+        uint8_t* p = Background.GetBitData() + i * 4;
+        p[0] = Channel();
+        p[1] = Channel();
+        p[2] = Channel();
+        p[3] = Options.Alpha ? Channel() : 255;
+    }
+
+    SyntheticCaptcha Out;
+    int Inner = Side - Border * 2;
+    Out.X = static_cast<int>(Random() % std::min(RealWidth, Options.Width - Inner + 1));
+    Out.Y = std::min(yStart + Border, Options.Height - Inner);
+    for (int y = 0; y < Inner; ++y) {
+        for (int x = 0; x < Inner; ++x) {
+            const uint8_t* From = Piece.GetBitData(24 + Border + x, yStart + Border + y);
+            uint8_t* To = Background.GetBitData(Out.X + x, Out.Y + y);
+            To[0] = BrightenTable[From[0]];
+            To[1] = BrightenTable[From[1]];
+            To[2] = From[2];
+            To[3] = BrightenTable[From[3]];
+        }
+    }
+
+    if (Options.Noise > 0) {
+        for (int i = 0; i < Options.Width * Options.Height; ++i) {
+            uint8_t* p = Background.GetBitData() + i * 4;
+            for (int c : { 0, 1, 3 }) {
+                if (c == 3 && !Options.Alpha) continue;
+                int Shift = static_cast<int>(Random() % (Options.Noise * 2 + 1)) - Options.Noise;
+                p[c] = static_cast<uint8_t>(std::clamp(p[c] + Shift, 0, 255));
+            }
+        }
+    }
+    Out.Answer = static_cast<float>(Out.X - 28) / 512;
+
+    if (Options.WhiteBar) {
+        Out.X = static_cast<int>(Random() % (RealWidth - 60));
+        Out.Y = static_cast<int>(Random() % RealHeight);
+        for (int x = Out.X; x < Out.X + 60; ++x) {
+            std::memset(Background.GetBitData(x, Out.Y), 0xFF, 4);
+        }
+        Out.Answer = static_cast<float>(Out.X) / Options.Width;
+    }
+
+    Out.Background = EncodeRTTEX(Background, RealWidth, RealHeight, Options.Alpha, Options.Packed);
+    Out.Piece = EncodeRTTEX(Piece, RealWidth, RealHeight, Options.Alpha, Options.Packed);
+    return Out;
+}
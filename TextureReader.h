@@ -0,0 +1,113 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+#pragma comment(lib, "zlib.lib")
+
+#pragma pack(push, 1)
+
+struct RTPACKHEADER {
+    char Magic[6];
+    uint8_t Version;
+    uint8_t Reserved;
+    uint32_t CompressedSize;
+    uint32_t DecompressedSize;
+    uint8_t CompressionType;
+    uint8_t Reserved2[15];
+};
+
+#pragma pack(pop)
+
+inline bool IsRTPACK(std::span<const uint8_t> Data) {
+    return Data.size() >= sizeof(RTPACKHEADER) && std::memcmp(Data.data(), "RTPACK", 6) == 0;
+}
+
+// Hands out texture bytes straight from the input buffer.
+class RawReader {
+private:
+    std::span<const uint8_t> Data;
+    size_t Offset = 0;
+
+public:
+    explicit RawReader(std::span<const uint8_t> Data) : Data(Data) { }
+
+    size_t Remaining() const {
+        return Data.size() - Offset;
+    }
+
+    const uint8_t* Next(size_t Size) {
+        if (Remaining() < Size) {
+            throw std::runtime_error("Truncated RTTEX data");
+        }
+        const uint8_t* Bytes = Data.data() + Offset;
+        Offset += Size;
+        return Bytes;
+    }
+};
+
+// Inflates an RTPACK payload on demand. Only the bytes asked for by the last
+// Next call are held, so a texture never exists uncompressed in full.
+class InflateReader {
+private:
+    z_stream Stream = {};
+    std::vector<uint8_t> Scratch;
+    size_t Produced = 0;
+    size_t Expected = 0;
+    bool Finished = false;
+
+public:
+    explicit InflateReader(std::span<const uint8_t> Data) {
+        RTPACKHEADER Header;
+        std::memcpy(&Header, Data.data(), sizeof(Header));
+        if (Header.CompressionType != 1) {
+            throw std::runtime_error("Unsupported RTPACK compression");
+        }
+
+        Expected = Header.DecompressedSize;
+        Data = Data.subspan(sizeof(Header));
+        Stream.next_in = const_cast<Bytef*>(Data.data());
+        Stream.avail_in = static_cast<uInt>(Data.size());
+        if (inflateInit(&Stream) != Z_OK) {
+            throw std::runtime_error("Failed to initialize inflate");
+        }
+    }
+
+    ~InflateReader() {
+        inflateEnd(&Stream);
+    }
+
+    InflateReader(const InflateReader&) = delete;
+    InflateReader& operator=(const InflateReader&) = delete;
+
+    size_t Remaining() const {
+        return Expected > Produced ? Expected - Produced : 0;
+    }
+
+    const uint8_t* Next(size_t Size) {
+        if (Scratch.size() < Size) {
+            Scratch.resize(Size);
+        }
+
+        Stream.next_out = Scratch.data();
+        Stream.avail_out = static_cast<uInt>(Size);
+        while (Stream.avail_out > 0) {
+            int Result = Finished ? Z_STREAM_END : inflate(&Stream, Z_NO_FLUSH);
+            if (Result == Z_STREAM_END) {
+                Finished = true;
+                if (Stream.avail_out > 0) {
+                    throw std::runtime_error("Truncated RTTEX data");
+                }
+            } else if (Result != Z_OK) {
+                throw std::runtime_error("Corrupt RTPACK data");
+            }
+        }
+
+        Produced += Size;
+        return Scratch.data();
+    }
+};
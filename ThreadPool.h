@@ -0,0 +1,263 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+class WorkerPool {
+private:
+    std::vector<std::thread> Threads;
+    std::deque<std::function<void()>> Tasks;
+    std::mutex Lock;
+    std::condition_variable Ready;
+    bool Stopping = false;
+
+public:
+    explicit WorkerPool(int Count) {
+        for (int i = 0; i < Count; ++i) {
+            Threads.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> Task;
+                    {
+                        std::unique_lock<std::mutex> Guard(Lock);
+                        Ready.wait(Guard, [this] { return Stopping || !Tasks.empty(); });
+                        if (Tasks.empty()) return;
+                        Task = std::move(Tasks.front());
+                        Tasks.pop_front();
+                    }
+                    Task();
+                }
+            });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Stopping = true;
+        }
+        Ready.notify_all();
+        for (auto& Thread : Threads) {
+            Thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int Size() const {
+        return static_cast<int>(Threads.size());
+    }
+
+    void Post(std::function<void()> Task) {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Tasks.push_back(std::move(Task));
+        }
+        Ready.notify_one();
+    }
+};
+
+// Searches rows [Begin, End) for the first hit in raster order. Row(y) returns
+// the hit column or -1. Rows are handed out in tiles of TileRows; the calling
+// thread always takes part, pool threads join in when they are free. Once a
+// tile has a hit, no tile after it is started and running ones stop at their
+// next row, while tiles before it still finish so the result stays the same
+// as a serial scan.
+template <class RowFn>
+bool ParallelFindFirst(WorkerPool* Pool, int Begin, int End, int TileRows, RowFn&& Row, int& OutX, int& OutY) {
+    if (End <= Begin) return false;
+
+    if (!Pool || Pool->Size() == 0 || End - Begin <= TileRows) {
+        for (int y = Begin; y < End; ++y) {
+            int x = Row(y);
+            if (x >= 0) {
+                OutX = x;
+                OutY = y;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Search {
+        int TileCount;
+        std::atomic<int> Next{ 0 };
+        std::atomic<int> Best;
+        std::vector<std::pair<int, int>> Hits;
+        std::mutex Lock;
+        std::condition_variable Idle;
+        int Active = 0;
+        bool Closed = false;
+
+        explicit Search(int Tiles) : TileCount(Tiles), Best(Tiles), Hits(Tiles) { }
+
+        bool Enter() {
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (Closed) return false;
+            ++Active;
+            return true;
+        }
+
+        void Leave() {
+            std::lock_guard<std::mutex> Guard(Lock);
+            if (--Active == 0) Idle.notify_all();
+        }
+    };
+
+    int TileCount = (End - Begin + TileRows - 1) / TileRows;
+    auto State = std::make_shared<Search>(TileCount);
+
+    auto Work = [&Row, Begin, End, TileRows](Search& S) {
+        for (;;) {
+            int Tile = S.Next.fetch_add(1, std::memory_order_relaxed);
+            if (Tile >= S.TileCount || Tile > S.Best.load(std::memory_order_acquire)) return;
+
+            int TileEnd = std::min(End, Begin + (Tile + 1) * TileRows);
+            for (int y = Begin + Tile * TileRows; y < TileEnd; ++y) {
+                if (S.Best.load(std::memory_order_relaxed) < Tile) return;
+                int x = Row(y);
+                if (x >= 0) {
+                    S.Hits[Tile] = { x, y };
+                    int Current = S.Best.load(std::memory_order_relaxed);
+                    while (Tile < Current && !S.Best.compare_exchange_weak(Current, Tile, std::memory_order_release)) { }
+                    break;
+                }
+            }
+        }
+    };
+
+    // Helpers may start after the caller is done; Enter() fails for those, so
+    // they never touch Work or Row once this frame is gone.
+    int Helpers = std::min(Pool->Size(), TileCount - 1);
+    for (int i = 0; i < Helpers; ++i) {
+        Pool->Post([State, Work = &Work] {
+            if (!State->Enter()) return;
+            (*Work)(*State);
+            State->Leave();
+        });
+    }
+
+    Work(*State);
+
+    {
+        std::unique_lock<std::mutex> Guard(State->Lock);
+        State->Closed = true;
+        State->Idle.wait(Guard, [&] { return State->Active == 0; });
+    }
+
+    int Best = State->Best.load(std::memory_order_acquire);
+    if (Best >= TileCount) return false;
+    OutX = State->Hits[Best].first;
+    OutY = State->Hits[Best].second;
+    return true;
+}
+
+// Fixed set of threads, each with its own task deque. A worker runs its own
+// newest task first and steals the oldest task of another worker when it runs
+// dry. Posts from a worker go to its own deque, so follow-up work stays on
+// the core that has the data; posts from outside are spread round-robin.
+class StealingPool {
+private:
+    struct Queue {
+        std::mutex Lock;
+        std::deque<std::function<void()>> Tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> Queues;
+    std::vector<std::thread> Threads;
+    std::mutex Lock;
+    std::condition_variable Ready;
+    // Tasks queued across all deques. A task can be taken before its Post
+    // counts it, so this may dip below zero for a moment.
+    std::atomic<int> Pending{ 0 };
+    std::atomic<size_t> NextQueue{ 0 };
+    bool Stopping = false;
+
+    inline static thread_local StealingPool* CurrentPool = nullptr;
+    inline static thread_local int CurrentIndex = -1;
+
+public:
+    explicit StealingPool(int Count) {
+        Count = std::max(1, Count);
+        for (int i = 0; i < Count; ++i) {
+            Queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 0; i < Count; ++i) {
+            Threads.emplace_back([this, i] {
+                CurrentPool = this;
+                CurrentIndex = i;
+                for (;;) {
+                    std::function<void()> Task;
+                    if (Take(i, Task)) {
+                        Task();
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> Guard(Lock);
+                    Ready.wait(Guard, [this] { return Stopping || Pending > 0; });
+                    if (Stopping && Pending <= 0) return;
+                }
+            });
+        }
+    }
+
+    // Runs everything already posted, then joins.
+    ~StealingPool() {
+        {
+            std::lock_guard<std::mutex> Guard(Lock);
+            Stopping = true;
+        }
+        Ready.notify_all();
+        for (auto& Thread : Threads) {
+            Thread.join();
+        }
+    }
+
+    StealingPool(const StealingPool&) = delete;
+    StealingPool& operator=(const StealingPool&) = delete;
+
+    int Size() const {
+        return static_cast<int>(Threads.size());
+    }
+
+    void Post(std::function<void()> Task) {
+        size_t Index = CurrentPool == this ? CurrentIndex : NextQueue.fetch_add(1, std::memory_order_relaxed) % Queues.size();
+        // Held for the whole post: a worker about to sleep can't miss the
+        // count, and a task that runs and lets the owner destroy the pool
+        // before Post returns leaves the destructor waiting here first.
+        std::lock_guard<std::mutex> Guard(Lock);
+        {
+            std::lock_guard<std::mutex> QueueGuard(Queues[Index]->Lock);
+            Queues[Index]->Tasks.push_back(std::move(Task));
+        }
+        ++Pending;
+        Ready.notify_one();
+    }
+
+private:
+    bool Take(int Index, std::function<void()>& Task) {
+        for (size_t i = 0; i < Queues.size(); ++i) {
+            Queue& Victim = *Queues[(Index + i) % Queues.size()];
+            std::lock_guard<std::mutex> Guard(Victim.Lock);
+            if (Victim.Tasks.empty()) continue;
+
+            if (i == 0) {
+                Task = std::move(Victim.Tasks.back());
+                Victim.Tasks.pop_back();
+            } else {
+                Task = std::move(Victim.Tasks.front());
+                Victim.Tasks.pop_front();
+            }
+            --Pending;
+            return true;
+        }
+        return false;
+    }
+};
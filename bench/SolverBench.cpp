@@ -0,0 +1,14 @@
+#include <cstdio>
+#include <cstdlib>
+#include "Benchmark.h"
+
+// bench [iterations] [threads]
+int main(int argc, char** argv) {
+    BenchmarkConfig Config;
+    if (argc > 1) Config.Iterations = std::atoi(argv[1]);
+    if (argc > 2) Config.Threads = std::atoi(argv[2]);
+
+    BenchmarkReport Report = RunBenchmark(Config);
+    printf("%s", Report.Format().c_str());
+    return Report.CorrectReplies == Report.Solves ? 0 : 1;
+}
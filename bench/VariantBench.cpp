@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+#include "variant.hpp"
+
+// Before and after for variant_t's move operations. CopyOnlyVariant declares
+// only the copy operations, so it copies wherever variant_t now moves, which
+// is how variant_t behaved before it had move operations.
+struct CopyOnlyVariant : variant_t {
+    using variant_t::variant_t;
+    CopyOnlyVariant(const CopyOnlyVariant&) = default;
+    CopyOnlyVariant& operator=(const CopyOnlyVariant&) = default;
+};
+
+static size_t Sink = 0;
+
+template <class Fn>
+static double NanosPerRun(int Runs, Fn&& Run) {
+    auto Start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Runs; ++i) Run();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count() / Runs;
+}
+
+// A 64-entry list of alternating strings and ints, grown one entry at a time.
+template <class Variant>
+static double BuildList(int Runs) {
+    std::string Text(200, 'x');
+    return NanosPerRun(Runs, [&] {
+        std::vector<Variant> List;
+        for (int k = 0; k < 64; ++k) {
+            List.push_back(k % 2 ? Variant(Text) : Variant(static_cast<int32_t>(k)));
+        }
+        Sink += List.size();
+    });
+}
+
+// What a packet handler does with the OnDialogRequest argument list.
+template <class Variant>
+static double PacketList(int Runs) {
+    std::vector<Variant> Packet;
+    Packet.emplace_back(std::string("set_default_color|`o\nadd_label_with_icon|big|`wAre you Human?``|left|206|\nadd_spacer|small|\n"
+                                    "add_puzzle_captcha|xx/puzzle_bg.rttex|xx/piece.rttex|ubistatic-a.akamaihd.net|abcdef|\n"
+                                    "end_dialog|puzzle_captcha_submit|||\n"));
+    Packet.emplace_back(static_cast<int32_t>(-1));
+    Packet.emplace_back(static_cast<uint32_t>(5));
+    Packet.emplace_back(1.5f, 2.0f);
+    Packet.emplace_back(static_cast<int32_t>(7));
+
+    return NanosPerRun(Runs, [&] {
+        std::vector<Variant> Copy = Packet;
+        std::vector<Variant> Moved = std::move(Copy);
+        Moved.push_back(Moved[0]);
+        Sink += Moved.size();
+    });
+}
+
+int main(int argc, char** argv) {
+    int Runs = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    printf("build a 64-entry mixed list:     copy-only %7.0f ns, move %7.0f ns\n", BuildList<CopyOnlyVariant>(Runs / 10),
+           BuildList<variant_t>(Runs / 10));
+    printf("copy + move + grow a packet list: copy-only %7.0f ns, move %7.0f ns\n", PacketList<CopyOnlyVariant>(Runs),
+           PacketList<variant_t>(Runs));
+    return Sink == 0;
+}
@@ -3,6 +3,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <array>
+#include <span>
+#include <cstdint>
+#include <string_view>
 #include <algorithm>
 #include "../utils.h"
 
@@ -93,6 +97,10 @@ public:
         return it != m_pairs.end() ? &(*it) : nullptr;
     }
 
+    const pair* find(const std::string& key) const {
+        return const_cast<rtvar*>(this)->find(key);
+    }
+
     std::string get(const std::string& key) const {
         auto it = std::find_if(m_pairs.begin(), m_pairs.end(),
             [&key](const pair& p) { return p.m_key == key; });
@@ -179,3 +187,170 @@ public:
         return m_var;
     }
 };
+
+// Read-only tokenization of a text packet that never allocates: keys and
+// values are string_views into the source, which must outlive the view.
+// Splits exactly like rtvar::parse. Up to max_pairs lines and max_fields
+// keys plus values fit; anything past that is dropped and truncated() is set,
+// which find_values answers by parsing the packet with rtvar::parse.
+class rtvar_view {
+public:
+    static constexpr size_t max_pairs = 32;
+    static constexpr size_t max_fields = 128;
+
+    class pair {
+    public:
+        std::string_view m_key;
+        const std::string_view* m_values = nullptr;
+        size_t m_count = 0;
+
+        size_t size() const {
+            return m_count;
+        }
+
+        // Empty when i is past the last value.
+        std::string_view value(size_t i = 0) const {
+            return i < m_count ? m_values[i] : std::string_view();
+        }
+
+        std::string_view operator[](size_t i) const {
+            return m_values[i];
+        }
+    };
+
+    explicit rtvar_view(std::string_view str) {
+        m_slots.fill(0);
+        while (!str.empty()) {
+            size_t end = str.find('\n');
+            append(str.substr(0, end));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            str.remove_prefix(end + 1);
+        }
+    }
+
+    // Points into this object, so it can't be copied.
+    rtvar_view(const rtvar_view&) = delete;
+    rtvar_view& operator=(const rtvar_view&) = delete;
+
+    size_t size() const {
+        return m_size;
+    }
+
+    const pair& get(size_t i) const {
+        if (i >= m_size) {
+            throw std::out_of_range("Index out of range");
+        }
+        return m_pairs[i];
+    }
+
+    bool valid() const {
+        return m_size != 0 && m_pairs[0].m_count != 0;
+    }
+
+    bool truncated() const {
+        return m_truncated;
+    }
+
+    // First line with this key, like rtvar::find.
+    const pair* find(std::string_view key) const {
+        for (size_t slot = hash(key) & slot_mask; m_slots[slot]; slot = (slot + 1) & slot_mask) {
+            const pair& p = m_pairs[m_slots[slot] - 1];
+            if (p.m_key == key) {
+                return &p;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string_view get(std::string_view key) const {
+        const pair* p = find(key);
+        return p ? p->value() : std::string_view();
+    }
+
+    // Copies the first out.size() values of key's first line in str. Packets
+    // too long for a view go through rtvar::parse instead. False when the line
+    // is missing or has fewer values.
+    static bool find_values(std::string_view str, std::string_view key, std::span<std::string> out) {
+        rtvar_view view(str);
+        if (const pair* p = view.find(key); p && p->size() >= out.size()) {
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = (*p)[i];
+            }
+            return true;
+        }
+        if (!view.truncated()) {
+            return false;
+        }
+
+        rtvar full = rtvar::parse(std::string(str));
+        const rtvar::pair* p = full.find(std::string(key));
+        if (!p || p->m_values.size() < out.size()) {
+            return false;
+        }
+        std::copy_n(p->m_values.begin(), out.size(), out.begin());
+        return true;
+    }
+
+private:
+    // Open addressing over pair index + 1, kept at most half full.
+    static constexpr size_t slot_mask = max_pairs * 2 - 1;
+
+    std::array<std::string_view, max_fields> m_fields;
+    std::array<pair, max_pairs> m_pairs;
+    std::array<uint8_t, max_pairs * 2> m_slots;
+    size_t m_size = 0;
+    size_t m_used = 0;
+    bool m_truncated = false;
+
+    static size_t hash(std::string_view key) {
+        uint32_t h = 2166136261u;
+        for (char c : key) {
+            h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return h;
+    }
+
+    void append(std::string_view line) {
+        if (m_size == max_pairs || m_used == max_fields) {
+            m_truncated = true;
+            return;
+        }
+
+        pair& p = m_pairs[m_size];
+        if (line.empty()) {
+            // rtvar::pair::parse gives an empty line this one placeholder value.
+            static constexpr std::string_view empty_value = "[EMPTY]";
+            p.m_key = {};
+            p.m_values = &empty_value;
+            p.m_count = 1;
+        } else {
+            size_t end = line.find('|');
+            p.m_key = line.substr(0, end);
+            p.m_values = m_fields.data() + m_used;
+            p.m_count = 0;
+
+            // A trailing '|' adds no empty value, as with std::getline.
+            while (end != std::string_view::npos && end + 1 < line.size()) {
+                if (m_used == max_fields) {
+                    m_truncated = true;
+                    break;
+                }
+                line.remove_prefix(end + 1);
+                end = line.find('|');
+                m_fields[m_used++] = line.substr(0, end);
+                ++p.m_count;
+            }
+        }
+
+        size_t slot = hash(p.m_key) & slot_mask;
+        for (; m_slots[slot]; slot = (slot + 1) & slot_mask) {
+            if (m_pairs[m_slots[slot] - 1].m_key == p.m_key) {
+                ++m_size;
+                return;
+            }
+        }
+        m_slots[slot] = static_cast<uint8_t>(++m_size);
+    }
+};
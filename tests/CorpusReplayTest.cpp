@@ -0,0 +1,98 @@
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "CorpusReplay.h"
+#include "SyntheticCaptcha.h"
+
+// Records solves whose piece came from the URL-keyed piece cache, then checks
+// that replaying the pack on a cold cache gives the answers the live solves
+// did.
+
+int main(int argc, char** argv) {
+    std::string Path = argc > 1 ? argv[1] : "corpus_replay_test.pack";
+    std::remove(Path.c_str());
+    std::remove((Path + ".idx").c_str());
+
+    auto Files = std::make_shared<MemoryFetcher>();
+    CaptchaOptions.Http = Files;
+    CaptchaOptions.Scheme = "mem://";
+    CaptchaOptions.Verbose = false;
+    CaptchaOptions.KeyPiecesByUrl = true;
+    CaptchaOptions.Pieces = std::make_shared<PieceCache>(64 << 20);
+    CaptchaOptions.Recorder = std::make_shared<CorpusRecorder>(Path);
+    int Failures = 0;
+
+    // Every captcha of a round shares one piece URL, so all but the first
+    // take the piece from the cache without downloading it.
+    const int Rounds = 3, PerRound = 4;
+    std::vector<float> Answers;
+    for (int Round = 0; Round < Rounds; ++Round) {
+        SyntheticOptions Options;
+        Options.Alpha = Round % 2;
+        Options.Seed = Round + 1;
+        SyntheticCaptcha Captcha = MakeSyntheticCaptcha(Options);
+        std::string Piece = "p" + std::to_string(Round) + ".rttex";
+        Files->Serve("mem://h/" + Piece, Captcha.Piece);
+
+        for (int i = 0; i < PerRound; ++i) {
+            std::string Background = "b" + std::to_string(Round) + "_" + std::to_string(i) + ".rttex";
+            Files->Serve("mem://h/" + Background, Captcha.Background);
+            variant_t Dialog("add_puzzle_captcha|" + Background + "|" + Piece + "|h|" + std::to_string(Answers.size()));
+            if (SolveCaptcha(Dialog) != CaptchaReply(Captcha.Answer, std::to_string(Answers.size()))) {
+                printf("FAIL live solve %zu\n", Answers.size());
+                ++Failures;
+            }
+            Answers.push_back(Captcha.Answer);
+        }
+    }
+    CaptchaOptions.Recorder.reset();
+
+    CorpusPack Pack(Path);
+    if (Pack.Size() != Answers.size()) {
+        printf("FAIL %zu of %zu solves recorded\n", Pack.Size(), Answers.size());
+        return 1;
+    }
+    for (size_t i = 0; i < Pack.Size(); ++i) {
+        if (Pack[i].Piece.empty()) {
+            printf("FAIL entry %zu recorded without its piece\n", i);
+            ++Failures;
+        }
+    }
+
+    // A cold cache, and threads that reach the entries in any order.
+    CaptchaOptions.Pieces = std::make_shared<PieceCache>(64 << 20);
+    ReplayReport Report = ReplayCorpus(Pack, 4, [&](size_t i, float Answer) {
+        if (Answer != Answers[i]) printf("FAIL replay of entry %zu gave %f, live %f\n", i, Answer, Answers[i]);
+    });
+    if (Report.Agreed != Answers.size()) {
+        printf("FAIL %zu agreed, %zu differed, %zu failed\n", Report.Agreed, Report.Differed, Report.Failed);
+        ++Failures;
+    }
+
+    // An entry without its piece still finds the model by URL once cached.
+    CorpusEntry First = Pack[0];
+    std::string Url = CaptchaOptions.Scheme + std::string(First.Fields[2]) + "/" + std::string(First.Fields[1]);
+    if (SolveTextures(First.Background, {}, Url) != Answers[0]) {
+        printf("FAIL pieceless entry not answered from the URL cache\n");
+        ++Failures;
+    }
+
+    // Offsets near the top of the range in a corrupt index end it rather
+    // than wrapping past the bounds checks.
+    if (FILE* Index = fopen((Path + ".idx").c_str(), "ab")) {
+        const uint64_t Corrupt[] = { UINT64_MAX - 7, UINT64_MAX - sizeof(CorpusRecordHeader) + 1 };
+        fwrite(Corrupt, sizeof(Corrupt), 1, Index);
+        fclose(Index);
+    }
+    if (CorpusPack(Path).Size() != Answers.size()) {
+        printf("FAIL corrupt index offsets accepted\n");
+        ++Failures;
+    }
+
+    std::remove(Path.c_str());
+    std::remove((Path + ".idx").c_str());
+    printf(Failures ? "%d replay failures\n" : "replay matches %d live solves\n", Failures ? Failures : static_cast<int>(Answers.size()));
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "SolveCaptcha.h"
+#include "HttpFetcher.h"
+#include "LoopbackServer.h"
+#include "SyntheticCaptcha.h"
+
+// Drives HttpFetcher and the whole solve pipeline through the loopback
+// stand-in server: keep-alive reuse, missing files, a cancel in the middle
+// of a body, and cancels racing completion.
+
+static std::vector<uint8_t> Pattern(size_t Size, uint32_t Seed) {
+    std::vector<uint8_t> Body(Size);
+    for (size_t i = 0; i < Size; ++i) Body[i] = static_cast<uint8_t>((i * 2654435761u + Seed) >> 13);
+    return Body;
+}
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    LoopbackServer Server;
+    auto Http = std::make_shared<HttpFetcher>(4);
+    std::string Base = "http://" + Server.Host() + "/";
+    int Failures = 0;
+
+    // One connection carries a run of requests.
+    std::vector<uint8_t> Small = Pattern(100000, 1);
+    Server.Serve("/small", Small);
+    for (int i = 0; i < 5; ++i) {
+        auto Fetched = Http->Fetch(Base + "small");
+        const std::vector<uint8_t>* Body = Fetched->Wait();
+        if (!Body || *Body != Small) {
+            printf("FAIL fetch %d of a served file\n", i);
+            ++Failures;
+        }
+    }
+    if (Server.Connections() != 1 || Http->IdleConnections() != 1) {
+        printf("FAIL %d connections for 5 requests in a row\n", Server.Connections());
+        ++Failures;
+    }
+
+    if (Http->Fetch(Base + "missing")->Wait() || Http->Fetch("https://" + Server.Host() + "/small")->Wait()) {
+        printf("FAIL missing file or https URL fetched\n");
+        ++Failures;
+    }
+
+    // Cancelled after the first chunk, long before the server is done sending.
+    std::vector<uint8_t> Large = Pattern(16 << 20, 2);
+    Server.Serve("/large", Large);
+    auto Request = Http->Fetch(Base + "large");
+    std::atomic<size_t> Seen{ 0 };
+    Request->OnData([&](FetchRequest& Running, std::span<const uint8_t> Chunk) {
+        Seen += Chunk.size();
+        Running.Cancel();
+    });
+    if (Request->Wait() || Seen == 0 || Seen >= Large.size()) {
+        printf("FAIL cancel mid-body: %zu of %zu bytes\n", Seen.load(), Large.size());
+        ++Failures;
+    }
+    // The shut down connection is dropped, not handed to the next request.
+    bool Pooled = Http->IdleConnections() != 0;
+    auto Next = Http->Fetch(Base + "small");
+    const std::vector<uint8_t>* After = Next->Wait();
+    if (Pooled || !After || *After != Small) {
+        printf("FAIL fetch after a cancel\n");
+        ++Failures;
+    }
+
+    // Cancels racing every stage of a transfer; each ends, whole or not at all.
+    std::vector<std::shared_ptr<FetchRequest>> Racing;
+    for (int i = 0; i < 200; ++i) {
+        Racing.push_back(Http->Fetch(Base + (i % 3 ? "small" : "large")));
+        if (i % 2) Racing.back()->Cancel();
+    }
+    for (size_t i = 0; i < Racing.size(); ++i) {
+        const std::vector<uint8_t>* Body = Racing[i]->Wait();
+        if (Body && *Body != (i % 3 ? Small : Large)) {
+            printf("FAIL racing fetch %zu gave a partial body\n", i);
+            ++Failures;
+        } else if (!Body && !Racing[i]->IsCancelled()) {
+            printf("FAIL racing fetch %zu failed without a cancel\n", i);
+            ++Failures;
+        }
+    }
+
+    // Whole solves, with and without the white bar, decoding after the
+    // download or while it streams in.
+    CaptchaOptions.Http = Http;
+    CaptchaOptions.Scheme = "http://";
+    for (int Case = 0; Case < 16; ++Case) {
+        SyntheticOptions Options;
+        Options.Width = Case % 4 == 0 ? 1024 : 512;
+        Options.Height = Case % 4 == 0 ? 1024 : 256;
+        Options.Alpha = Case % 2;
+        Options.WhiteBar = Case % 3 == 0;
+        Options.Packed = Case % 5 == 0;
+        Options.Seed = Case + 1;
+        CaptchaOptions.StreamDecode = Case % 2 == 0;
+        CaptchaOptions.StreamEarlyExit = Case % 4 == 0;
+        SyntheticCaptcha Captcha = MakeSyntheticCaptcha(Options);
+
+        std::string Id = std::to_string(Case);
+        Server.Serve("/b" + Id + ".rttex", Captcha.Background);
+        Server.Serve("/p" + Id + ".rttex", Captcha.Piece);
+        variant_t Dialog("add_puzzle_captcha|b" + Id + ".rttex|p" + Id + ".rttex|" + Server.Host() + "|" + Id);
+        if (SolveCaptcha(Dialog) != CaptchaReply(Captcha.Answer, Id)) {
+            printf("FAIL solve %d through the loopback server\n", Case);
+            ++Failures;
+        }
+    }
+    CaptchaOptions.Http.reset();
+
+    // Destroying the fetcher cancels what is still running.
+    for (int i = 0; i < 8; ++i) Http->Fetch(Base + "large");
+    Http.reset();
+
+    printf(Failures ? "%d fetch failures\n" : "fetch pipeline works over loopback, %d requests\n", Failures ? Failures : Server.Requests());
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "SolveCaptcha.h"
+#include "SyntheticCaptcha.h"
+#include "MatchFixtures.h"
+
+// Checks the luma screen in front of the piece match against the plain RGBA
+// scan, with every channel of a window moved to the edge of the tolerance,
+// and the luma plane decoded alongside the texture against one built after.
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    CaptchaOptions.Engine = MatchEngine::Exact;
+    std::mt19937 Random(16);
+    int Failures = 0, Matches = 0, Wrapped = 0;
+
+    std::vector<std::pair<const char*, LumaFindFn>> Kernels = { { "scalar", LumaFindScalar } };
+#ifdef SIMD_X86
+    Kernels.push_back({ "sse2", LumaFindSSE2 });
+    if (CpuFeatures::Get().AVX2) Kernels.push_back({ "avx2", LumaFindAVX2 });
+#endif
+
+    // The table matches the per-pixel float curve it replaced.
+    for (int Value = 0; Value < 256; ++Value) {
+        volatile float Channel = static_cast<float>(Value);
+        int Old = std::min(255, static_cast<int>(Channel + ((-166.f * Channel / 255.f) + 166.f)));
+        if (BrightenTable[Value] != Old) {
+            printf("FAIL brighten %d gave %d, not %d\n", Value, BrightenTable[Value], Old);
+            ++Failures;
+        }
+    }
+
+    for (int Case = 0; Case < 1200; ++Case) {
+        BitMap Square = RandomSquare(Random);
+        bool FromSquare = Case % 4 != 0;
+        PieceTemplate Template(Square);
+        if (!FromSquare) {
+            std::vector<uint32_t> Window(1 + Random() % 250);
+            for (uint32_t& Pixel : Window) Pixel = static_cast<uint32_t>(Random());
+            Template = PieceTemplate(static_cast<int>(1 + Random() % 40), std::move(Window), 2);
+        }
+
+        SceneOptions Options;
+        Options.Width = static_cast<int>(30 + Random() % 200);
+        Options.Height = static_cast<int>(Template.Rows + 1 + Random() % 30);
+        Options.Copies = static_cast<int>(Random() % 4);
+        Options.Edge = Case % 3 != 0;
+        Options.Noise = Options.Edge && Case % 5 == 0 ? 3 : 2;
+        BitMap Image = MakeScene(Template, Options, Random);
+        int RealWidth = Options.Width - static_cast<int>(Random() % (Options.Width / 8 + 1));
+
+        int WantX = -1, WantY = -1;
+        bool Want = ReferenceFindPiece(Image, RealWidth, 0, Options.Height, Template, WantX, WantY);
+        Matches += Want;
+        Wrapped += Want && WantX + Template.Width > Options.Width;
+
+        // The SIMD luma rows match the scalar ones.
+        LumaPlane Luma(Image);
+        std::vector<uint8_t> Expected(Options.Width);
+        for (int y = 0; y < Options.Height; ++y) {
+            LumaRowScalar(Image.Row<RGBA8>(y).data(), Expected.data(), Options.Width);
+            if (std::memcmp(Luma.Row(y).data(), Expected.data(), Expected.size()) != 0) {
+                printf("FAIL luma row %d in case %d\n", y, Case);
+                ++Failures;
+                break;
+            }
+        }
+
+        for (const auto& [Name, Kernel] : Kernels) {
+            LumaScanner Scanner(Image, Luma, RealWidth, Template, Kernel);
+            int X = -1, Y = -1;
+            bool Found = ParallelFindFirst(nullptr, 0, Options.Height, 1, Scanner, X, Y);
+            if (Found != Want || (Found && (X != WantX || Y != WantY))) {
+                printf("FAIL %s luma scan in case %d: (%d, %d) instead of (%d, %d)\n", Name, Case, Found ? X : -1, Found ? Y : -1, WantX, WantY);
+                ++Failures;
+            }
+        }
+
+        // The luma find kernels agree on every start and length.
+        for (int Start = 0; Start < 40; ++Start) {
+            int Count = static_cast<int>(Random() % (Options.Width + 1));
+            uint8_t Target = Luma.Row(0)[Random() % Options.Width];
+            int Tolerance = static_cast<int>(Random() % 4);
+            int Scalar = LumaFindScalar(Luma.Row(0).data(), Count, Target, Tolerance);
+            for (const auto& [Name, Kernel] : Kernels) {
+                if (Kernel(Luma.Row(0).data(), Count, Target, Tolerance) != Scalar) {
+                    printf("FAIL %s luma find in case %d\n", Name, Case);
+                    ++Failures;
+                }
+            }
+        }
+
+        // The plane filled while decoding, and the whole search with the
+        // prefilter on and off.
+        if (!FromSquare) continue;
+        for (bool Packed : { false, true }) {
+            std::vector<uint8_t> File = EncodeRTTEX(Image, RealWidth, Options.Height, true, Packed);
+            RTTEX Fused(File, false, true);
+            LumaPlane Built(*Fused.GetMap());
+            if (!Fused.GetLuma() || std::memcmp(Fused.GetLuma()->GetBitData(), Built.GetBitData(), static_cast<size_t>(Options.Width) * Options.Height) != 0) {
+                printf("FAIL decoded luma plane in case %d%s\n", Case, Packed ? " packed" : "");
+                ++Failures;
+            }
+
+            float Answer = Want ? PieceAnswer(WantX) : 0.0f;
+            for (bool Prefilter : { false, true }) {
+                CaptchaOptions.LumaPrefilter = Prefilter;
+                if (AnswerByEquation(Fused, &Square) != Answer) {
+                    printf("FAIL AnswerByEquation in case %d, prefilter %d\n", Case, Prefilter);
+                    ++Failures;
+                }
+            }
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "luma prefilter matches, %d matches, %d wrapped\n", Failures ? Failures : Matches, Wrapped);
+    return Failures || !Wrapped ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "BitMap.h"
+#include "Matcher.h"
+
+// Backgrounds with piece windows planted at random origins, and the match
+// loop AnswerByEquation ran before the search was rewritten, for the tests
+// that check every search path against it.
+
+inline bool OldNear(const RGB_A& a, const RGB_A& b) {
+    return std::abs(a.r - b.r) < 3 && std::abs(a.g - b.g) < 3 && std::abs(a.b - b.b) < 3;
+}
+
+// One past the last pixel a window of Template reads, from its origin.
+inline long long WindowReach(const PieceTemplate& Template, int Stride) {
+    long long Reach = 0;
+    for (int Row = 0; Row < Template.Rows; ++Row) {
+        Reach = std::max(Reach, static_cast<long long>(Row) * Stride + Template.RowLength(Row));
+    }
+    return Reach;
+}
+
+// The original AnswerByEquation loop over a MakeSquare output, giving the
+// origin instead of the answer. It read past the bitmap for origins whose
+// window runs off the end; those are skipped, as the new scans do.
+inline bool OldFindPiece(BitMap& Image, int RealWidth, int RealHeight, BitMap& Square, int& OutX, int& OutY) {
+    long long Total = static_cast<long long>(Image.Width) * Image.Height;
+    long long Reach = WindowReach(PieceTemplate(Square), Image.Width);
+    for (int Y = 0; Y < RealHeight; ++Y) {
+        for (int X = 0; X < RealWidth; ++X) {
+            if (static_cast<long long>(Y) * Image.Width + X + Reach > Total) continue;
+            if (OldNear(Image.GetPixelRGBA(X, Y), Square.GetPixelRGBA(12, 12))) {
+                int MatchCount = 0;
+                bool matched = true;
+                for (int y = 12; y < Square.Height - 12 && matched; ++y) {
+                    for (int x = 12; x < Square.Width - 12; ++x) {
+                        if (!OldNear(Image.GetPixelRGBA(X + x - 12, Y + y - 12), Square.GetPixelRGBA(x, y))) {
+                            matched = false;
+                            break;
+                        }
+                        if (++MatchCount > 200) {
+                            OutX = X;
+                            OutY = Y;
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// The same walk for any template: the first Count window pixels in raster
+// order, rows Width apart, each within the template's tolerance.
+inline bool ReferenceFindPiece(BitMap& Image, int XLimit, int YBegin, int YEnd, const PieceTemplate& Template, int& OutX, int& OutY) {
+    if (!Template.Valid()) return false;
+
+    const uint32_t* Pixels = reinterpret_cast<const uint32_t*>(Image.GetBitData());
+    long long Total = static_cast<long long>(Image.Width) * Image.Height;
+    long long Reach = WindowReach(Template, Image.Width);
+    for (int Y = YBegin; Y < YEnd; ++Y) {
+        for (int X = 0; X < XLimit; ++X) {
+            long long Origin = static_cast<long long>(Y) * Image.Width + X;
+            if (Origin + Reach > Total) continue;
+
+            bool Matched = true;
+            for (int k = 0; k < Template.Count && Matched; ++k) {
+                RGB_A a, b;
+                std::memcpy(static_cast<void*>(&a), Pixels + Origin + (k / Template.Width) * Image.Width + k % Template.Width, sizeof(a));
+                std::memcpy(static_cast<void*>(&b), &Template.Pixels[k], sizeof(b));
+                Matched = isNearEquation(a, b, Template.Tolerance);
+            }
+            if (Matched) {
+                OutX = X;
+                OutY = Y;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// A random MakeSquare-sized square. Some pixels are fully transparent, which
+// sample picking has to skip.
+inline BitMap RandomSquare(std::mt19937& Random) {
+    BitMap Square(50, 50);
+    for (int i = 0; i < 50 * 50; ++i) {
+        uint32_t Pixel = static_cast<uint32_t>(Random());
+        if (Random() % 8 == 0) Pixel &= 0xFF00FFFF;
+        std::memcpy(Square.GetBitData() + i * 4, &Pixel, sizeof(Pixel));
+    }
+    return Square;
+}
+
+// Moves r, g and b of Pixel by up to Noise each, or by exactly Noise with
+// Edge, and sets a random alpha, which no search compares.
+inline uint32_t Jitter(uint32_t Pixel, int Noise, bool Edge, std::mt19937& Random) {
+    uint8_t* p = reinterpret_cast<uint8_t*>(&Pixel);
+    for (int c : { 0, 1, 3 }) {
+        int Shift = Edge ? (Random() % 2 ? Noise : -Noise) : static_cast<int>(Random() % (Noise * 2 + 1)) - Noise;
+        // Clamping would shrink the shift; flip it instead.
+        if (p[c] + Shift < 0 || p[c] + Shift > 255) Shift = -Shift;
+        p[c] = static_cast<uint8_t>(p[c] + Shift);
+    }
+    p[2] = static_cast<uint8_t>(Random());
+    return Pixel;
+}
+
+// Writes the first Pixels window pixels of Template at (X, Y), rows Width
+// apart like the scans read them, so a window near the right edge wraps onto
+// the next row.
+inline void PlantWindow(BitMap& Image, const PieceTemplate& Template, int X, int Y, int Pixels, int Noise, bool Edge, std::mt19937& Random) {
+    uint32_t* Out = reinterpret_cast<uint32_t*>(Image.GetBitData());
+    size_t Total = static_cast<size_t>(Image.Width) * Image.Height;
+    size_t Origin = static_cast<size_t>(Y) * Image.Width + X;
+    for (int k = 0; k < std::min(Pixels, Template.Count); ++k) {
+        size_t At = Origin + static_cast<size_t>(k / Template.Width) * Image.Width + k % Template.Width;
+        if (At < Total) Out[At] = Jitter(Template.Pixels[k], Noise, Edge, Random);
+    }
+}
+
+struct SceneOptions {
+    int Width = 0;
+    int Height = 0;
+    // Whole windows, each moved by up to Noise per channel.
+    int Copies = 2;
+    int Noise = 2;
+    // Every channel of a window moved by exactly Noise.
+    bool Edge = false;
+    // Chance that one pixel of a whole window is moved by 3, past the tolerance.
+    int BreakPercent = 20;
+};
+
+// A random background where a tenth of the pixels are near the template's
+// first pixel and some windows are planted only in part, so the scans spend
+// their time in the verify paths, plus Copies whole windows anywhere, wrapped
+// ones included.
+inline BitMap MakeScene(const PieceTemplate& Template, const SceneOptions& Options, std::mt19937& Random) {
+    BitMap Image(Options.Height, Options.Width);
+    uint32_t* Pixels = reinterpret_cast<uint32_t*>(Image.GetBitData());
+    int Total = Options.Width * Options.Height;
+    for (int i = 0; i < Total; ++i) {
+        Pixels[i] = Random() % 10 == 0 ? Jitter(Template.Pixels[0], 2, false, Random) : static_cast<uint32_t>(Random());
+    }
+
+    auto Origin = [&](int& X, int& Y) {
+        X = static_cast<int>(Random() % Options.Width);
+        Y = static_cast<int>(Random() % Options.Height);
+    };
+
+    for (int Partial = Random() % 6; Partial > 0; --Partial) {
+        int X, Y;
+        Origin(X, Y);
+        PlantWindow(Image, Template, X, Y, static_cast<int>(Random() % Template.Count), 2, false, Random);
+    }
+
+    for (int Copy = 0; Copy < Options.Copies; ++Copy) {
+        int X, Y;
+        Origin(X, Y);
+        PlantWindow(Image, Template, X, Y, Template.Count, Options.Noise, Options.Edge, Random);
+        if (static_cast<int>(Random() % 100) < Options.BreakPercent) {
+            int k = static_cast<int>(Random() % Template.Count);
+            size_t At = static_cast<size_t>(Y) * Options.Width + X + static_cast<size_t>(k / Template.Width) * Options.Width + k % Template.Width;
+            if (At < static_cast<size_t>(Total)) {
+                uint8_t* p = reinterpret_cast<uint8_t*>(Pixels + At);
+                const uint8_t* Want = reinterpret_cast<const uint8_t*>(&Template.Pixels[k]);
+                static const int Channels[] = { 0, 1, 3 };
+                int c = Channels[Random() % 3];
+                p[c] = static_cast<uint8_t>(Want[c] >= 3 ? Want[c] - 3 : Want[c] + 3);
+            }
+        }
+    }
+    return Image;
+}
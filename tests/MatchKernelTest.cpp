@@ -0,0 +1,82 @@
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "SolveCaptcha.h"
+#include "SyntheticCaptcha.h"
+#include "MatchFixtures.h"
+
+// Checks the scalar, SSE4.1 and AVX2 match kernels against the original
+// AnswerByEquation loop, on windows planted at the edge of the tolerance and
+// wrapped across row ends, and with templates of every row length.
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    std::mt19937 Random(4);
+    int Failures = 0, Matches = 0, Wrapped = 0;
+
+    std::vector<std::pair<const char*, FindInRowFn>> Kernels = { { "scalar", MatchScalar::FindInRow } };
+#ifdef SIMD_X86
+    if (CpuFeatures::Get().SSE41) Kernels.push_back({ "sse4.1", MatchSSE41::FindInRow });
+    if (CpuFeatures::Get().AVX2) Kernels.push_back({ "avx2", MatchAVX2::FindInRow });
+#endif
+
+    for (int Case = 0; Case < 1500; ++Case) {
+        // Mostly MakeSquare templates; the rest are any width and length so
+        // the short-row and overlapping-load paths run too.
+        BitMap Square = RandomSquare(Random);
+        bool FromSquare = Case % 4 != 0;
+        PieceTemplate Template(Square);
+        if (!FromSquare) {
+            std::vector<uint32_t> Window(1 + Random() % 250);
+            for (uint32_t& Pixel : Window) Pixel = static_cast<uint32_t>(Random());
+            Template = PieceTemplate(static_cast<int>(1 + Random() % 40), std::move(Window), 2);
+        }
+
+        SceneOptions Options;
+        Options.Width = static_cast<int>(30 + Random() % 200);
+        Options.Height = static_cast<int>(Template.Rows + 1 + Random() % 30);
+        Options.Copies = static_cast<int>(Random() % 4);
+        Options.Edge = Case % 3 == 0;
+        // Exactly 3 everywhere never matches; exactly 2 always does.
+        Options.Noise = Options.Edge && Case % 2 ? 3 : 2;
+        BitMap Image = MakeScene(Template, Options, Random);
+        int RealWidth = Options.Width - static_cast<int>(Random() % (Options.Width / 8 + 1));
+        int RealHeight = Options.Height - static_cast<int>(Random() % (Options.Height / 8 + 1));
+
+        int WantX = -1, WantY = -1;
+        bool Want = ReferenceFindPiece(Image, RealWidth, 0, RealHeight, Template, WantX, WantY);
+        if (FromSquare) {
+            int OldX = -1, OldY = -1;
+            bool Old = OldFindPiece(Image, RealWidth, RealHeight, Square, OldX, OldY);
+            if (Old != Want || OldX != WantX || OldY != WantY) {
+                printf("FAIL reference differs from the original loop in case %d\n", Case);
+                ++Failures;
+            }
+        }
+        Matches += Want;
+        Wrapped += Want && WantX + Template.Width > Options.Width;
+
+        for (const auto& [Name, Kernel] : Kernels) {
+            int X = -1, Y = -1;
+            bool Found = FindPiece(Image, RealWidth, 0, RealHeight, Template, X, Y, Kernel);
+            if (Found != Want || (Found && (X != WantX || Y != WantY))) {
+                printf("FAIL %s kernel in case %d: (%d, %d) instead of (%d, %d)\n", Name, Case, Found ? X : -1, Found ? Y : -1, WantX, WantY);
+                ++Failures;
+            }
+        }
+
+        // The whole AnswerByEquation on the same image as an RGBA texture.
+        if (FromSquare) {
+            RTTEX Decoded(EncodeRTTEX(Image, RealWidth, RealHeight, true, false));
+            float Expected = Want ? static_cast<float>(WantX - 28) / 512 : 0.0f;
+            if (AnswerByEquation(Decoded, &Square) != Expected) {
+                printf("FAIL AnswerByEquation in case %d\n", Case);
+                ++Failures;
+            }
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "match kernels agree, %d matches, %d wrapped\n", Failures ? Failures : Matches, Wrapped);
+    return Failures || !Wrapped ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "rtparam.hpp"
+
+// Checks rtvar_view against rtvar::parse on random packets: empty lines,
+// trailing and doubled '|', repeated keys, and packets past the view's line
+// and field limits, where find_values has to fall back to rtvar::parse.
+
+static std::string RandomPacket(std::mt19937& Random) {
+    static const char* const Keys[] = { "add_puzzle_captcha", "action", "dialog_name", "a", "" };
+    static const char* const Values[] = { "", "x", "bg.rttex", "piece.rttex", "host", "42" };
+    std::string Packet;
+    int Lines = static_cast<int>(Random() % 80);
+    for (int Line = 0; Line < Lines; ++Line) {
+        if (Line) Packet += '\n';
+        if (Random() % 8 == 0) continue;
+        Packet += Keys[Random() % 5];
+        int Count = static_cast<int>(Random() % (Random() % 10 == 0 ? 80 : 7));
+        for (int v = 0; v < Count; ++v) {
+            Packet.append("|").append(Values[Random() % 6]);
+        }
+        if (Random() % 6 == 0) Packet += '|';
+    }
+    if (Random() % 4 == 0) Packet += '\n';
+    return Packet;
+}
+
+int main() {
+    std::mt19937 Random(12);
+    int Failures = 0, Truncated = 0;
+
+    for (int Case = 0; Case < 20000; ++Case) {
+        std::string Packet = RandomPacket(Random);
+        // A late captcha line, past the view's line limit when long.
+        if (Case % 3 == 0) Packet.append("\nadd_puzzle_captcha|b.rttex|p.rttex|host|id");
+
+        rtvar Full = rtvar::parse(Packet);
+        rtvar_view View(Packet);
+        Truncated += View.truncated();
+
+        // Every line the view kept matches rtvar's; a line cut short by the
+        // field limit keeps a prefix of its values.
+        bool Same = View.size() <= Full.size() && (View.truncated() || View.size() == Full.size());
+        for (size_t i = 0; Same && i < View.size(); ++i) {
+            const rtvar_view::pair& Got = View.get(i);
+            const rtvar::pair& Want = Full.get(i);
+            Same = Got.m_key == Want.m_key && Got.size() <= Want.m_values.size() &&
+                   (View.truncated() || Got.size() == Want.m_values.size());
+            for (size_t v = 0; Same && v < Got.size(); ++v) {
+                Same = Got[v] == Want.m_values[v];
+            }
+        }
+        if (!Same) {
+            printf("FAIL lines differ in case %d\n", Case);
+            ++Failures;
+        }
+
+        std::array<std::string, 4> Fields;
+        const rtvar::pair* Captcha = Full.find("add_puzzle_captcha");
+        bool Expected = Captcha && Captcha->m_values.size() >= 4;
+        bool Found = rtvar_view::find_values(Packet, "add_puzzle_captcha", Fields);
+        bool Match = Found == Expected;
+        for (size_t i = 0; Match && Found && i < Fields.size(); ++i) {
+            Match = Fields[i] == Captcha->m_values[i];
+        }
+        if (!Match) {
+            printf("FAIL add_puzzle_captcha differs in case %d%s\n", Case, View.truncated() ? ", truncated" : "");
+            ++Failures;
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "rtvar_view matches rtvar::parse, %d packets past its limits\n", Failures ? Failures : Truncated);
+    return Failures || !Truncated ? 1 : 0;
+}
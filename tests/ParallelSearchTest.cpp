@@ -0,0 +1,136 @@
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "SolveCaptcha.h"
+#include "SyntheticCaptcha.h"
+#include "MatchFixtures.h"
+
+// Checks that ParallelFindFirst gives the first hit in raster order, the one a
+// serial scan does, for every pool size and tile height, when several rows and
+// several tiles have hits.
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    std::mt19937 Random(5);
+    int Failures = 0, Hits = 0;
+
+    std::vector<std::shared_ptr<WorkerPool>> Pools = { nullptr, std::make_shared<WorkerPool>(1), std::make_shared<WorkerPool>(3),
+                                                       std::make_shared<WorkerPool>(7) };
+
+    // Rows with hits at random, where the row function takes random time so
+    // later tiles often finish first.
+    for (int Case = 0; Case < 2000; ++Case) {
+        int Begin = static_cast<int>(Random() % 20);
+        int End = Begin + static_cast<int>(Random() % 300);
+        std::vector<int> Columns(End);
+        int Chance = static_cast<int>(Random() % 50);
+        for (int& x : Columns) x = static_cast<int>(Random() % 1000) < Chance ? static_cast<int>(Random() % 500) : -1;
+
+        int WantX = -1, WantY = -1;
+        for (int y = Begin; y < End && WantY < 0; ++y) {
+            if (Columns[y] >= 0) {
+                WantX = Columns[y];
+                WantY = y;
+            }
+        }
+        Hits += WantY >= 0;
+
+        const auto& Pool = Pools[Case % Pools.size()];
+        int TileRows = static_cast<int>(1 + Random() % 12);
+        unsigned Spin = Random() % 2000;
+        int X = -1, Y = -1;
+        bool Found = ParallelFindFirst(Pool.get(), Begin, End, TileRows, [&](int Row) {
+            volatile unsigned Sink = 0;
+            for (unsigned i = 0; i < (Row * 7919u) % (Spin + 1); ++i) Sink = Sink + i;
+            return Columns[Row];
+        }, X, Y);
+        if (Found != (WantY >= 0) || (Found && (X != WantX || Y != WantY))) {
+            printf("FAIL rows [%d, %d) in tiles of %d: (%d, %d) instead of (%d, %d)\n", Begin, End, TileRows, X, Y, WantX, WantY);
+            ++Failures;
+        }
+    }
+
+    // The piece scan on backgrounds with several copies, wrapped ones
+    // included, over random row ranges.
+    for (int Case = 0; Case < 300; ++Case) {
+        BitMap Square = RandomSquare(Random);
+        PieceTemplate Template(Square);
+        SceneOptions Options;
+        Options.Width = static_cast<int>(40 + Random() % 200);
+        Options.Height = static_cast<int>(Template.Rows + 1 + Random() % 80);
+        Options.Copies = static_cast<int>(2 + Random() % 4);
+        Options.Edge = Case % 2;
+        BitMap Image = MakeScene(Template, Options, Random);
+
+        int Begin = static_cast<int>(Random() % (Options.Height / 2));
+        int End = Begin + static_cast<int>(Random() % (Options.Height - Begin + 1));
+        int WantX = -1, WantY = -1;
+        bool Want = ReferenceFindPiece(Image, Options.Width, Begin, End, Template, WantX, WantY);
+
+        for (const auto& Pool : Pools) {
+            int TileRows = static_cast<int>(1 + Random() % 8);
+            PieceScanner Scanner(Image, Options.Width, Template);
+            int X = -1, Y = -1;
+            bool Found = ParallelFindFirst(Pool.get(), Begin, End, TileRows, Scanner, X, Y);
+            if (Found != Want || (Found && (X != WantX || Y != WantY))) {
+                printf("FAIL piece scan case %d, %d threads, tiles of %d\n", Case, Pool ? Pool->Size() : 0, TileRows);
+                ++Failures;
+            }
+        }
+
+        // The whole search on the same image as a texture, with and without
+        // the pool.
+        std::vector<uint8_t> File = EncodeRTTEX(Image, Options.Width, Options.Height, true, false);
+        WantX = WantY = -1;
+        Want = ReferenceFindPiece(Image, Options.Width, 0, Options.Height, Template, WantX, WantY);
+        float Expected = Want ? PieceAnswer(WantX) : 0.0f;
+        for (const auto& Pool : Pools) {
+            CaptchaOptions.SearchPool = Pool;
+            CaptchaOptions.SearchTileRows = static_cast<int>(1 + Random() % 8);
+            RTTEX Decoded(File);
+            RTTEX Lazy(File, RTTEX::Lazy, 4);
+            if (AnswerByEquation(Decoded, &Square) != Expected || AnswerByEquation(Lazy, &Square) != Expected) {
+                printf("FAIL AnswerByEquation case %d, %d threads\n", Case, Pool ? Pool->Size() : 0);
+                ++Failures;
+            }
+        }
+    }
+
+    // White bars on several rows: GetAnswer takes the first.
+    for (int Case = 0; Case < 200; ++Case) {
+        int Width = static_cast<int>(60 + Random() % 200), Height = static_cast<int>(1 + Random() % 120);
+        BitMap Map(Height, Width);
+        for (int y = 0; y < Height; ++y) {
+            for (int x = 0; x < Width; ++x) {
+                uint32_t Pixel = static_cast<uint32_t>(Random()) & 0xFFFFFFFE;
+                std::memcpy(Map.GetBitData(x, y), &Pixel, sizeof(Pixel));
+            }
+        }
+        int First = Height;
+        for (int Bars = static_cast<int>(Random() % 4); Bars > 0; --Bars) {
+            int y = static_cast<int>(Random() % Height), x = static_cast<int>(Random() % (Width - 51));
+            std::memset(Map.GetBitData(x, y), 0xFF, 51 * 4);
+            First = std::min(First, y);
+        }
+
+        RunIndex Whites(Map, 0xFFFFFFFF, Height);
+        float Expected = First < Height ? static_cast<float>(FindWhiteBar(Whites, First, Width, Width)) / Width : 0.0f;
+        std::vector<uint8_t> File = EncodeRTTEX(Map, Width, Height, true, false);
+        for (const auto& Pool : Pools) {
+            CaptchaOptions.SearchPool = Pool;
+            CaptchaOptions.SearchTileRows = static_cast<int>(1 + Random() % 8);
+            RTTEX Decoded(File);
+            RTTEX Lazy(File, RTTEX::Lazy, 4);
+            if (GetAnswer(Decoded) != Expected || GetAnswer(Lazy) != Expected) {
+                printf("FAIL GetAnswer case %d, %d threads\n", Case, Pool ? Pool->Size() : 0);
+                ++Failures;
+            }
+        }
+    }
+    CaptchaOptions.SearchPool.reset();
+
+    printf(Failures ? "%d mismatches\n" : "parallel search matches serial, %d hits\n", Failures ? Failures : Hits);
+    return Failures ? 1 : 0;
+}
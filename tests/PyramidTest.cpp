@@ -0,0 +1,152 @@
+#include <array>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include "SolveCaptcha.h"
+#include "SyntheticCaptcha.h"
+#include "MatchFixtures.h"
+
+// Checks the coarse-to-fine search against the full-resolution scan for every
+// way it gets its coarse level and templates, on odd sizes, random row bands
+// and windows wrapped across row ends.
+
+// File bytes of Image with Mip stored after it as the second level.
+static std::vector<uint8_t> EncodeWithMip(BitMap& Image, BitMap& Mip, int RealWidth, int RealHeight) {
+    std::vector<uint8_t> File = EncodeRTTEX(Image, RealWidth, RealHeight, true, false);
+    int Levels = 2;
+    std::memcpy(File.data() + 8 + offsetof(RTTEXINFO, MipMapCount), &Levels, sizeof(Levels));
+
+    std::vector<uint8_t> Level = EncodeRTTEX(Mip, Mip.Width, Mip.Height, true, false);
+    RTTEXMIPHEADER Header = { Mip.Height, Mip.Width, static_cast<int>(Level.size() - RTTEX::HeaderSize), 1, { 0, 0 } };
+    const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(&Header);
+    File.insert(File.end(), Bytes, Bytes + sizeof(Header));
+    File.insert(File.end(), Level.begin() + RTTEX::HeaderSize, Level.end());
+    return File;
+}
+
+// A half level that rounds where HalfSize truncates, as other mip filters do.
+static std::unique_ptr<BitMap> HalfSizeRounded(BitMap& Source) {
+    auto Half = std::make_unique<BitMap>(Source.Height / 2, Source.Width / 2);
+    for (int y = 0; y < Half->Height; ++y) {
+        for (int x = 0; x < Half->Width; ++x) {
+            const uint8_t* a = Source.GetBitData(x * 2, y * 2);
+            const uint8_t* b = Source.GetBitData(x * 2, y * 2 + 1);
+            uint8_t* Out = Half->GetBitData(x, y);
+            for (int c = 0; c < 4; ++c) Out[c] = static_cast<uint8_t>((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+        }
+    }
+    return Half;
+}
+
+static bool Same(bool Found, int X, int Y, bool Want, int WantX, int WantY) {
+    return Found == Want && (!Found || (X == WantX && Y == WantY));
+}
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    CaptchaOptions.Engine = MatchEngine::Exact;
+    std::mt19937 Random(6);
+    int Failures = 0, Matches = 0, Wrapped = 0;
+
+    for (int Case = 0; Case < 800; ++Case) {
+        BitMap Square = RandomSquare(Random);
+        bool FromSquare = Case % 4 != 0;
+        PieceTemplate Template(Square);
+        if (!FromSquare) {
+            std::vector<uint32_t> Window(1 + Random() % 250);
+            for (uint32_t& Pixel : Window) Pixel = static_cast<uint32_t>(Random());
+            Template = PieceTemplate(static_cast<int>(1 + Random() % 40), std::move(Window), 2);
+        }
+        std::array<PieceTemplate, 4> Halves;
+        for (int Phase = 0; Phase < 4; ++Phase) Halves[Phase] = HalfSizeTemplate(Template, Phase % 2, Phase / 2);
+
+        SceneOptions Options;
+        Options.Width = static_cast<int>(31 + Random() % 200);
+        Options.Height = static_cast<int>(Template.Rows + 1 + Random() % 60);
+        Options.Copies = static_cast<int>(Random() % 4);
+        Options.Edge = Case % 3 == 0;
+        Options.Noise = Options.Edge && Case % 2 ? 3 : 2;
+        BitMap Image = MakeScene(Template, Options, Random);
+        int XLimit = Options.Width - static_cast<int>(Random() % (Options.Width / 8 + 1));
+        int YBegin = static_cast<int>(Random() % 3 ? 0 : Random() % Options.Height);
+        int YEnd = YBegin + static_cast<int>(Random() % (Options.Height - YBegin + 1));
+        if (Case % 2) YEnd = Options.Height;
+
+        int WantX = -1, WantY = -1;
+        bool Want = ReferenceFindPiece(Image, XLimit, YBegin, YEnd, Template, WantX, WantY);
+        Matches += Want;
+        Wrapped += Want && WantX + Template.Width > Options.Width;
+
+        auto Box = HalfSize(Image);
+        auto Rounded = HalfSizeRounded(Image);
+        BitMap Odd(Options.Height / 2 + 1, Options.Width / 2);
+        struct Mode {
+            const char* Name;
+            BitMap* Coarse;
+            const std::array<PieceTemplate, 4>* Halves;
+            bool BoxFiltered;
+        };
+        const Mode Modes[] = {
+            { "no coarse", nullptr, nullptr, false },
+            { "box coarse", Box.get(), nullptr, true },
+            { "box coarse and halves", Box.get(), &Halves, true },
+            { "box coarse not marked", Box.get(), &Halves, false },
+            { "coarse of the wrong size", &Odd, &Halves, false },
+        };
+        for (const Mode& M : Modes) {
+            int X = -1, Y = -1;
+            bool Found = FindPiecePyramid(Image, XLimit, YBegin, YEnd, Template, X, Y, M.Coarse, M.Halves, M.BoxFiltered);
+            if (!Same(Found, X, Y, Want, WantX, WantY)) {
+                printf("FAIL %s in case %d: (%d, %d) instead of (%d, %d)\n", M.Name, Case, Found ? X : -1, Found ? Y : -1, WantX, WantY);
+                ++Failures;
+            }
+        }
+
+        // A level filtered some other way may miss a window, so all that
+        // holds is that what it finds is a match, and that it finds one
+        // whenever there is one.
+        int X = -1, Y = -1;
+        bool Found = FindPiecePyramid(Image, XLimit, YBegin, YEnd, Template, X, Y, Rounded.get(), &Halves, false);
+        PieceScanner Fine(Image, XLimit, Template);
+        if (Found != Want || (Found && (Y < YBegin || Y >= YEnd || X >= XLimit || !Fine.Matches(X, Y)))) {
+            printf("FAIL rounded coarse in case %d: (%d, %d)\n", Case, Found ? X : -1, Found ? Y : -1);
+            ++Failures;
+        }
+
+        // The whole search, with the half level built per search or taken
+        // from the file, full scan or geometry band first.
+        if (!FromSquare) continue;
+        PieceModel Model(PieceTemplate(Square), CorrelationPatch(Square, PieceTemplate::Border));
+        Model.SquareY = static_cast<int>(Random() % Options.Height);
+        std::vector<uint8_t> File = EncodeWithMip(Image, *Box, XLimit, Options.Height);
+        for (bool Band : { false, true }) {
+            CaptchaOptions.GeometryBand = Band;
+            CaptchaOptions.BandMargin = static_cast<int>(Random() % 20);
+            int Center = Model.SquareY + PieceTemplate::Border;
+            int BandBegin = std::clamp(Center - CaptchaOptions.BandMargin, 0, Options.Height);
+            int BandEnd = std::clamp(Center + CaptchaOptions.BandMargin + 1, BandBegin, Options.Height);
+            int BandX = -1, BandY = -1;
+            bool BandWant = Band ? ReferenceFindPiece(Image, XLimit, BandBegin, BandEnd, Template, BandX, BandY) ||
+                                       ReferenceFindPiece(Image, XLimit, 0, BandBegin, Template, BandX, BandY) ||
+                                       ReferenceFindPiece(Image, XLimit, BandEnd, Options.Height, Template, BandX, BandY)
+                                 : ReferenceFindPiece(Image, XLimit, 0, Options.Height, Template, BandX, BandY);
+            float Expected = BandWant ? PieceAnswer(BandX) : 0.0f;
+
+            for (int Setting = 0; Setting < 3; ++Setting) {
+                CaptchaOptions.CoarseToFine = Setting > 0;
+                CaptchaOptions.UseFileMips = Setting == 2;
+                RTTEX Decoded(File, CaptchaOptions.UseFileMips);
+                if (AnswerByEquation(Decoded, Model) != Expected) {
+                    printf("FAIL AnswerByEquation in case %d, band %d, setting %d\n", Case, Band, Setting);
+                    ++Failures;
+                }
+            }
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "pyramid search matches, %d matches, %d wrapped\n", Failures ? Failures : Matches, Wrapped);
+    return Failures || !Wrapped ? 1 : 0;
+}
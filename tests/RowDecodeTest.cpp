@@ -0,0 +1,153 @@
+#include <span>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <zlib.h>
+#include "RTTEX.h"
+#include "RowDecode.h"
+#include "StreamDecode.h"
+
+// Checks every row decoder against the per-pixel struct copies RTTEX used
+// before rows were decoded whole, on raw and RTPACK-wrapped fixtures.
+
+static std::vector<uint8_t> MakeTexture(int Width, int Height, bool Alpha, uint32_t Seed) {
+    RTTEXINFO Info = {};
+    Info.Height = Height;
+    Info.Width = Width;
+    Info.Format = 5121;
+    Info.RealHeight = Height;
+    Info.RealWidth = Width;
+    Info.useAlpha = Alpha;
+    Info.MipMapCount = 1;
+
+    size_t Pixels = static_cast<size_t>(Width) * Height * (Alpha ? 4 : 3);
+    std::vector<uint8_t> File(RTTEX::HeaderSize + Pixels);
+    std::memcpy(File.data(), "RTTXTR", 6);
+    std::memcpy(File.data() + 8, &Info, sizeof(Info));
+    RTTEXMIPHEADER Mip = { Height, Width, static_cast<int>(Pixels), 0, { 0, 0 } };
+    std::memcpy(File.data() + RTTEX::HeaderSize - sizeof(Mip), &Mip, sizeof(Mip));
+
+    std::mt19937 Random(Seed);
+    for (size_t i = RTTEX::HeaderSize; i < File.size(); ++i) {
+        File[i] = static_cast<uint8_t>(Random());
+    }
+    return File;
+}
+
+static std::vector<uint8_t> Pack(const std::vector<uint8_t>& File) {
+    uLongf Size = compressBound(static_cast<uLong>(File.size()));
+    std::vector<uint8_t> Packed(sizeof(RTPACKHEADER) + Size);
+    compress(Packed.data() + sizeof(RTPACKHEADER), &Size, File.data(), static_cast<uLong>(File.size()));
+
+    RTPACKHEADER Header = {};
+    std::memcpy(Header.Magic, "RTPACK", 6);
+    Header.Version = 1;
+    Header.CompressedSize = static_cast<uint32_t>(Size);
+    Header.DecompressedSize = static_cast<uint32_t>(File.size());
+    Header.CompressionType = 1;
+    std::memcpy(Packed.data(), &Header, sizeof(Header));
+    Packed.resize(sizeof(RTPACKHEADER) + Size);
+    return Packed;
+}
+
+// The original decode loop, reading one pixel struct at a time.
+static std::vector<uint8_t> OldDecode(const std::vector<uint8_t>& File, int Width, int Height, bool Alpha) {
+    std::vector<uint8_t> Bits(static_cast<size_t>(Width) * Height * 4);
+    const uint8_t* Source = File.data() + RTTEX::HeaderSize;
+    for (int y = Height - 1; y >= 0; --y) {
+        for (int x = 0; x < Width; ++x) {
+            int index = (x + y * Width) * sizeof(int);
+            if (Alpha) {
+                RGB_A rgba;
+                std::memcpy(&rgba, Source, sizeof(rgba));
+                Source += sizeof(rgba);
+                Bits[index + 0] = rgba.b;
+                Bits[index + 1] = rgba.g;
+                Bits[index + 2] = rgba.r;
+                Bits[index + 3] = rgba.a;
+            } else {
+                ColorRGB rgb;
+                std::memcpy(&rgb, Source, sizeof(rgb));
+                Source += sizeof(rgb);
+                Bits[index + 0] = rgb.b;
+                Bits[index + 1] = rgb.g;
+                Bits[index + 2] = rgb.r;
+                Bits[index + 3] = 0xFF;
+            }
+        }
+    }
+    return Bits;
+}
+
+static int Failures = 0;
+
+static void Expect(bool Same, const char* What, int Width, int Height, bool Alpha) {
+    if (Same) return;
+    printf("FAIL %s %dx%d %s\n", What, Width, Height, Alpha ? "RGBA" : "RGB");
+    ++Failures;
+}
+
+static bool SameBits(BitMap& Map, const std::vector<uint8_t>& Expected) {
+    return std::memcmp(Map.GetBitData(), Expected.data(), Expected.size()) == 0;
+}
+
+int main() {
+    struct Kernel {
+        const char* Name;
+        RowDecoder Rgba, Rgb;
+        bool Supported;
+    };
+    std::vector<Kernel> Kernels = { { "scalar", DecodeRowRGBAScalar, DecodeRowRGBScalar, true } };
+#ifdef SIMD_X86
+    const CpuFeatures& Cpu = CpuFeatures::Get();
+    Kernels.push_back({ "sse", DecodeRowRGBASSE2, DecodeRowRGBSSSE3, Cpu.SSSE3 });
+    Kernels.push_back({ "avx2", DecodeRowRGBAAVX2, DecodeRowRGBAVX2, Cpu.AVX2 });
+#endif
+
+    const int Sizes[][2] = { { 1, 1 }, { 3, 2 }, { 5, 3 }, { 7, 5 }, { 8, 8 }, { 9, 4 }, { 17, 9 }, { 33, 31 }, { 64, 64 }, { 255, 3 }, { 513, 7 } };
+    uint32_t Seed = 1;
+    for (auto& Size : Sizes) {
+        for (bool Alpha : { false, true }) {
+            int Width = Size[0], Height = Size[1];
+            std::vector<uint8_t> File = MakeTexture(Width, Height, Alpha, Seed++);
+            std::vector<uint8_t> Packed = Pack(File);
+            std::vector<uint8_t> Expected = OldDecode(File, Width, Height, Alpha);
+
+            // Each kernel on its own, row by row.
+            size_t RowBytes = static_cast<size_t>(Width) * (Alpha ? 4 : 3);
+            for (const Kernel& K : Kernels) {
+                if (!K.Supported) continue;
+                std::vector<uint8_t> Bits(Expected.size());
+                for (int y = 0; y < Height; ++y) {
+                    const uint8_t* Row = File.data() + RTTEX::HeaderSize + (Height - 1 - y) * RowBytes;
+                    (Alpha ? K.Rgba : K.Rgb)(Row, Bits.data() + static_cast<size_t>(y) * Width * 4, Width);
+                }
+                Expect(Bits == Expected, K.Name, Width, Height, Alpha);
+            }
+
+            RTTEX Raw{ std::span<const uint8_t>(File) };
+            Expect(SameBits(*Raw.GetMap(), Expected), "raw", Width, Height, Alpha);
+
+            RTTEX Inflated{ std::span<const uint8_t>(Packed) };
+            Expect(SameBits(*Inflated.GetMap(), Expected), "rtpack", Width, Height, Alpha);
+
+            RTTEX Lazy(File, RTTEX::Lazy, 4);
+            Expect(SameBits(*Lazy.GetMap(), Expected), "lazy", Width, Height, Alpha);
+
+            // Odd chunk sizes split rows and the headers across pushes.
+            for (const std::vector<uint8_t>* Source : { &File, &Packed }) {
+                RTTEXStream Stream;
+                for (size_t At = 0; At < Source->size(); At += 7) {
+                    Stream.Push(std::span<const uint8_t>(*Source).subspan(At, std::min<size_t>(7, Source->size() - At)));
+                }
+                Expect(Stream.Complete() && SameBits(*Stream.GetImage()->GetMap(), Expected), Source == &File ? "stream" : "stream rtpack",
+                       Width, Height, Alpha);
+            }
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "all decoders match\n", Failures);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "SolveCaptcha.h"
+#include "MatchFixtures.h"
+
+// Checks that the sparse sample check in front of the dense compare never
+// changes a result: every kernel gives the same origin with the samples as
+// without them, including for windows broken only at a sample pixel.
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    std::mt19937 Random(7);
+    int Failures = 0, Matches = 0, SampleBreaks = 0;
+
+    std::vector<std::pair<const char*, FindInRowFn>> Kernels = { { "scalar", MatchScalar::FindInRow } };
+#ifdef SIMD_X86
+    if (CpuFeatures::Get().SSE41) Kernels.push_back({ "sse4.1", MatchSSE41::FindInRow });
+    if (CpuFeatures::Get().AVX2) Kernels.push_back({ "avx2", MatchAVX2::FindInRow });
+#endif
+
+    for (int Case = 0; Case < 1500; ++Case) {
+        BitMap Square = RandomSquare(Random);
+        bool HasAlpha = Case % 2;
+        PieceTemplate Template(Square, HasAlpha);
+        PieceTemplate Dense = Template;
+        Dense.Samples.clear();
+
+        // Samples are distinct window pixels other than the first, never
+        // transparent ones when the alpha is real.
+        std::vector<bool> Seen(Template.Count);
+        for (const auto& Sample : Template.Samples) {
+            int i = Sample.y * Template.Width + Sample.x;
+            bool Transparent = reinterpret_cast<const uint8_t*>(&Template.Pixels[i])[2] == 0;
+            if (Sample.x < 0 || Sample.x >= Template.Width || i <= 0 || i >= Template.Count || Seen[i] || (HasAlpha && Transparent)) {
+                printf("FAIL sample (%d, %d) in case %d\n", Sample.x, Sample.y, Case);
+                ++Failures;
+                break;
+            }
+            Seen[i] = true;
+        }
+        if (Template.Samples.empty() || Template.Samples.size() > PieceTemplate::SampleRows * PieceTemplate::SampleColumns) {
+            printf("FAIL %zu samples in case %d\n", Template.Samples.size(), Case);
+            ++Failures;
+        }
+
+        SceneOptions Options;
+        Options.Width = static_cast<int>(30 + Random() % 200);
+        Options.Height = static_cast<int>(Template.Rows + 1 + Random() % 30);
+        Options.Copies = static_cast<int>(Random() % 3);
+        Options.Edge = Case % 3 == 0;
+        BitMap Image = MakeScene(Template, Options, Random);
+
+        // Whole windows off by 3 at one sample only, which only the sample
+        // check or the dense rows may turn down.
+        uint32_t* Pixels = reinterpret_cast<uint32_t*>(Image.GetBitData());
+        for (int Break = static_cast<int>(Random() % 3); Break > 0 && !Template.Samples.empty(); --Break) {
+            int X = static_cast<int>(Random() % Options.Width), Y = static_cast<int>(Random() % Options.Height);
+            PlantWindow(Image, Template, X, Y, Template.Count, 2, Options.Edge, Random);
+            const auto& Sample = Template.Samples[Random() % Template.Samples.size()];
+            size_t At = static_cast<size_t>(Y + Sample.y) * Options.Width + X + Sample.x;
+            if (At >= static_cast<size_t>(Options.Width) * Options.Height) continue;
+            uint8_t* p = reinterpret_cast<uint8_t*>(Pixels + At);
+            const uint8_t* Want = reinterpret_cast<const uint8_t*>(&Template.Pixels[Sample.y * Template.Width + Sample.x]);
+            int c = Random() % 2 ? 0 : 3;
+            p[c] = static_cast<uint8_t>(Want[c] >= 3 ? Want[c] - 3 : Want[c] + 3);
+            ++SampleBreaks;
+        }
+
+        int WantX = -1, WantY = -1;
+        bool Want = ReferenceFindPiece(Image, Options.Width, 0, Options.Height, Template, WantX, WantY);
+        Matches += Want;
+
+        for (const auto& [Name, Kernel] : Kernels) {
+            for (const PieceTemplate* Used : { &Template, &Dense }) {
+                int X = -1, Y = -1;
+                bool Found = FindPiece(Image, Options.Width, 0, Options.Height, *Used, X, Y, Kernel);
+                if (Found != Want || (Found && (X != WantX || Y != WantY))) {
+                    printf("FAIL %s kernel %s samples in case %d\n", Name, Used == &Dense ? "without" : "with", Case);
+                    ++Failures;
+                }
+            }
+        }
+
+        // The luma screen checks the samples on the luma plane instead.
+        LumaPlane Luma(Image);
+        for (const PieceTemplate* Used : { &Template, &Dense }) {
+            LumaScanner Scanner(Image, Luma, Options.Width, *Used);
+            int X = -1, Y = -1;
+            bool Found = ParallelFindFirst(nullptr, 0, Options.Height, 1, Scanner, X, Y);
+            if (Found != Want || (Found && (X != WantX || Y != WantY))) {
+                printf("FAIL luma scan %s samples in case %d\n", Used == &Dense ? "without" : "with", Case);
+                ++Failures;
+            }
+        }
+    }
+
+    printf(Failures ? "%d mismatches\n" : "sample checks keep every result, %d matches, %d sample breaks\n", Failures ? Failures : Matches,
+           SampleBreaks);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#include <span>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <functional>
+#include <zlib.h>
+#include "SolveCaptcha.h"
+#include "StreamDecode.h"
+#include "SyntheticCaptcha.h"
+
+// Checks that textures whose unpadded size doesn't fit the stored one are
+// refused by every decode path before any search reads past the image.
+
+static bool Throws(const std::function<void()>& Run) {
+    try {
+        Run();
+    } catch (const std::exception&) {
+        return true;
+    }
+    return false;
+}
+
+static std::vector<uint8_t> Pack(const std::vector<uint8_t>& File) {
+    uLongf Size = compressBound(static_cast<uLong>(File.size()));
+    std::vector<uint8_t> Packed(sizeof(RTPACKHEADER) + Size);
+    compress(Packed.data() + sizeof(RTPACKHEADER), &Size, File.data(), static_cast<uLong>(File.size()));
+
+    RTPACKHEADER Header = {};
+    std::memcpy(Header.Magic, "RTPACK", 6);
+    Header.Version = 1;
+    Header.CompressedSize = static_cast<uint32_t>(Size);
+    Header.DecompressedSize = static_cast<uint32_t>(File.size());
+    Header.CompressionType = 1;
+    std::memcpy(Packed.data(), &Header, sizeof(Header));
+    Packed.resize(sizeof(RTPACKHEADER) + Size);
+    return Packed;
+}
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    int Failures = 0;
+
+    BitMap Map(64, 64);
+    std::vector<uint8_t> Good = EncodeRTTEX(Map, 64, 64, true, false);
+    if (Throws([&] { RTTEX Image(Good); GetAnswer(Image); })) {
+        printf("FAIL valid 64x64 texture refused\n");
+        ++Failures;
+    }
+
+    struct Corruption {
+        const char* Name;
+        size_t Field;
+        int Value;
+    };
+    const Corruption Cases[] = {
+        { "RealHeight 1<<20", offsetof(RTTEXINFO, RealHeight), 1 << 20 },
+        { "RealHeight 65", offsetof(RTTEXINFO, RealHeight), 65 },
+        { "RealHeight 0", offsetof(RTTEXINFO, RealHeight), 0 },
+        { "RealHeight -1", offsetof(RTTEXINFO, RealHeight), -1 },
+        { "RealWidth 1<<20", offsetof(RTTEXINFO, RealWidth), 1 << 20 },
+        { "RealWidth 0", offsetof(RTTEXINFO, RealWidth), 0 },
+        { "Height 0", offsetof(RTTEXINFO, Height), 0 },
+    };
+
+    for (const Corruption& Case : Cases) {
+        for (bool Packed : { false, true }) {
+            std::vector<uint8_t> File = EncodeRTTEX(Map, 64, 64, true, false);
+            std::memcpy(File.data() + 8 + Case.Field, &Case.Value, sizeof(Case.Value));
+            if (Packed) File = Pack(File);
+
+            bool Refused = Throws([&] { RTTEX Image(File); GetAnswer(Image); }) &&
+                           Throws([&] { RTTEX Image(File, RTTEX::Lazy); GetAnswer(Image); }) &&
+                           Throws([&] { RTTEXStream Stream; Stream.Push(File); }) &&
+                           Throws([&] { SolveTextures(File, Good, "mem://piece"); }) &&
+                           Throws([&] { SolveTextures(Good, File, "mem://piece"); });
+            if (!Refused) {
+                printf("FAIL %s%s accepted\n", Case.Name, Packed ? " packed" : "");
+                ++Failures;
+            }
+        }
+    }
+
+    printf(Failures ? "%d malformed headers accepted\n" : "malformed headers refused\n", Failures);
+    return Failures ? 1 : 0;
+}
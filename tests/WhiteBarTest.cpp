@@ -0,0 +1,101 @@
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "SolveCaptcha.h"
+#include "SyntheticCaptcha.h"
+
+// Checks the run-length white bar search against the per-pixel scan GetAnswer
+// used before, on rows with every density of white.
+
+static int OldFindWhiteBar(BitMap& Map, int Y, int RealWidth) {
+    const RGB_A WhiteColor(255, 255, 255, 255);
+    const int threshold = 50;
+    for (int X = 0; X < RealWidth; ++X) {
+        if (Map.GetPixelRGBA(X, Y) == WhiteColor) {
+            int WhitePixelCount = 1;
+            for (int i = 1; i < 60 && X + i < Map.Width; ++i) {
+                if (Map.GetPixelRGBA(X + i, Y) == WhiteColor) {
+                    if (++WhitePixelCount > threshold) return X;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static float OldGetAnswer(BitMap& Map, int RealWidth, int RealHeight) {
+    for (int Y = 0; Y < RealHeight; ++Y) {
+        int X = OldFindWhiteBar(Map, Y, RealWidth);
+        if (X >= 0) return static_cast<float>(X) / Map.Width;
+    }
+    return 0.0f;
+}
+
+int main() {
+    CaptchaOptions.Verbose = false;
+    std::mt19937 Random(11);
+    int Failures = 0, Bars = 0;
+
+    for (int Case = 0; Case < 400; ++Case) {
+        int Width = 1 + Random() % 300;
+        int Height = 1 + Random() % 20;
+        int RealWidth = Width - Random() % (Width / 4 + 1);
+        int Density = Random() % 100;
+
+        // Near-white pixels catch a comparison that ignores a channel.
+        BitMap Map(Height, Width);
+        for (int y = 0; y < Height; ++y) {
+            for (int x = 0; x < Width; ++x) {
+                uint32_t Pixel = static_cast<int>(Random() % 100) < Density ? 0xFFFFFFFF : Random() % 3 ? 0xFFFFFFFE : Random();
+                std::memcpy(Map.GetBitData(x, y), &Pixel, sizeof(Pixel));
+            }
+        }
+
+        RunIndex Whites(Map, 0xFFFFFFFF, Height);
+        for (int y = 0; y < Height; ++y) {
+            int Expected = OldFindWhiteBar(Map, y, RealWidth);
+            if (FindWhiteBar(Whites, y, RealWidth, Width) != Expected) {
+                printf("FAIL row %d of %dx%d, density %d\n", y, Width, Height, Density);
+                ++Failures;
+            }
+            Bars += Expected >= 0;
+        }
+
+        // The whole search, eager and lazy, on the same image as a texture.
+        int RealHeight = Height - Random() % (Height / 4 + 1);
+        std::vector<uint8_t> File = EncodeRTTEX(Map, RealWidth, RealHeight, true, false);
+        RTTEX Decoded(File);
+        float Expected = OldGetAnswer(*Decoded.GetMap(), RealWidth, RealHeight);
+        RTTEX Lazy(File, RTTEX::Lazy, 4);
+        if (GetAnswer(Decoded) != Expected || GetAnswer(Lazy) != Expected) {
+            printf("FAIL GetAnswer on %dx%d, density %d\n", Width, Height, Density);
+            ++Failures;
+        }
+    }
+
+    // The row mask kernels agree with each other.
+    for (int Width = 0; Width < 200; ++Width) {
+        std::vector<uint32_t> Row(Width);
+        for (uint32_t& Pixel : Row) Pixel = Random() % 2 ? 0xFFFFFFFF : Random();
+        size_t Words = (Width + 63) / 64;
+        std::vector<uint64_t> Expected(Words), Bits(Words);
+        RowMaskScalar(Row.data(), Width, 0xFFFFFFFF, Expected.data());
+#ifdef SIMD_X86
+        std::vector<RowMaskFn> Kernels = { RowMaskSSE2 };
+        if (CpuFeatures::Get().AVX2) Kernels.push_back(RowMaskAVX2);
+        for (RowMaskFn Mask : Kernels) {
+            std::fill(Bits.begin(), Bits.end(), 0);
+            Mask(Row.data(), Width, 0xFFFFFFFF, Bits.data());
+            if (Bits != Expected) {
+                printf("FAIL row mask at width %d\n", Width);
+                ++Failures;
+            }
+        }
+#endif
+    }
+
+    printf(Failures ? "%d mismatches\n" : "white bar search matches, %d bars\n", Failures ? Failures : Bars);
+    return Failures ? 1 : 0;
+}
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <cstring>
 #include <string>
+#include <string_view>
+#include <utility>
 #include "vector.hpp"
 
 #define C_VAR_SPACE_BYTES 16
@@ -12,7 +14,8 @@ public:
     enum class vartype_t { TYPE_UNUSED, TYPE_FLOAT, TYPE_STRING, TYPE_VECTOR2, TYPE_VECTOR3, TYPE_UINT32, TYPE_ENTITY, TYPE_COMPONENT, TYPE_RECT, TYPE_INT32 };
 
     variant_t() : m_type(vartype_t::TYPE_UNUSED), m_pointer(nullptr) {}
-    variant_t(const variant_t& v) { *this = v; }
+    variant_t(const variant_t& v) : variant_t() { *this = v; }
+    variant_t(variant_t&& v) noexcept : variant_t() { *this = std::move(v); }
     variant_t(int32_t var) : variant_t() { set(var); }
     variant_t(uint32_t var) : variant_t() { set(var); }
     variant_t(float var) : variant_t() { set(var); }
@@ -22,6 +25,7 @@ public:
     variant_t(const vector3_t& v3) : variant_t() { set(v3); }
     variant_t(const rect_t& r) : variant_t() { set(r); }
     variant_t(const std::string& var) : variant_t() { set(var); }
+    variant_t(std::string&& var) : variant_t() { set(std::move(var)); }
 
     void reset() { m_type = vartype_t::TYPE_UNUSED; }
 
@@ -47,7 +51,9 @@ public:
     void operator=(int32_t var) { set(var); }
     void operator=(uint32_t var) { set(var); }
     void operator=(const std::string& var) { set(var); }
+    void operator=(std::string&& var) { set(std::move(var)); }
     void set(const std::string& var) { m_type = vartype_t::TYPE_STRING; m_string = var; }
+    void set(std::string&& var) { m_type = vartype_t::TYPE_STRING; m_string = std::move(var); }
     void operator=(const vector2_t& var) { set(var); }
     void set(const vector2_t& var) { m_type = vartype_t::TYPE_VECTOR2; *reinterpret_cast<vector2_t*>(m_var) = var; }
     void set(float x, float y) { set(vector2_t(x, y)); }
@@ -69,6 +75,7 @@ public:
     const int32_t& get_int32() const { return *reinterpret_cast<const int32_t*>(m_var); }
     const uint32_t& get_uint32() const { return *reinterpret_cast<const uint32_t*>(m_var); }
     const std::string& get_string() const { return m_string; }
+    std::string_view get_string_view() const { return m_string; }
     const vector2_t& get_vector2() const { return *reinterpret_cast<const vector2_t*>(m_var); }
     const vector3_t& get_vector3() const { return *reinterpret_cast<const vector3_t*>(m_var); }
     const rect_t& get_rect() const { return *reinterpret_cast<const rect_t*>(m_var); }
@@ -91,12 +98,24 @@ public:
         }
     }
 
+    // Only string variants carry m_string; other types leave it empty.
     variant_t& operator=(const variant_t& rhs) {
         if (this != &rhs) {
             m_type = rhs.m_type;
-            m_pointer = rhs.m_pointer;
             std::memcpy(m_var, rhs.m_var, C_VAR_SPACE_BYTES);
-            m_string = rhs.m_string;
+            if (m_type == vartype_t::TYPE_STRING) m_string = rhs.m_string;
+            else m_string.clear();
+        }
+        return *this;
+    }
+
+    variant_t& operator=(variant_t&& rhs) noexcept {
+        if (this != &rhs) {
+            m_type = rhs.m_type;
+            std::memcpy(m_var, rhs.m_var, C_VAR_SPACE_BYTES);
+            if (m_type == vartype_t::TYPE_STRING) m_string = std::move(rhs.m_string);
+            else m_string.clear();
+            rhs.m_string.clear();
         }
         return *this;
     }